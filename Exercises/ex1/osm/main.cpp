@@ -1,17 +1,819 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fnmatch.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
 #include "osm.h"
+#include "osm_cpu.h"
 
-int main ()
+#define EXIT_REGRESSION 2
+#define DEFAULT_THRESHOLD 0.05
+#define QUICK_MIN_TRIALS 5
+#define QUICK_MAX_TRIALS 30
+#define QUICK_TARGET_CI 0.05
+#define MIN_LATENCY_BYTES (16 << 10)
+#define MAX_LATENCY_BYTES (64 << 20)
+#define BANDWIDTH_BYTES (64 << 20)
+#define PAGING_BYTES (8 << 20)
+#define SMALL_STACK_BYTES ((size_t) 16 << 10)
+#define LARGE_STACK_BYTES ((size_t) 8 << 20)
+#define PERCENT 100
+#define MIN_QUANTUM_US 10u
+#define MAX_QUANTUM_US 100000u
+#define MIN_TICKS 20u
+#define MAX_TICKS 1000u
+#define US_PER_SEC 1000000u
+
+/**
+ * A benchmark the command line can select. Benchmarks with an extra name
+ * also report one more value besides their results (e.g. a throughput).
+ */
+struct Benchmark {
+    std::string name;
+    const char *unit;
+    const char *extra;
+    std::function<int (const osm_config *, osm_results *, double *)> run;
+};
+
+/**
+ * Outcome of a selected benchmark, compared to the baseline when given
+ */
+struct Outcome {
+    const Benchmark *benchmark;
+    bool measured;
+    osm_results results;
+    double extra;
+    bool compared;
+    osm_results baseline;
+    osm_change change;
+};
+
+/**
+ * Command line options
+ */
+struct Options {
+    bool list = false;
+    bool quick = false;
+    bool counters = false;
+    std::string format = "text";
+    std::string output;
+    std::string baseline;
+    std::string timer;
+    double threshold = DEFAULT_THRESHOLD;
+    std::vector<std::string> filters;
+};
+
+static const char *const TIMER_NAMES[] = {"gettimeofday", "monotonic_raw", "tsc"};
+static const char *const CHANGE_NAMES[] = {"unchanged", "improved", "regressed"};
+
+/**
+ * Helper function that names a size in bytes with the largest unit that
+ * divides it
+ * @param bytes the size
+ * @return the name, e.g. "8b", "4k" or "1m"
+ */
+static std::string size_name (size_t bytes)
 {
-  double op = osm_operation_time (200000);
+  if (bytes % (1 << 20) == 0)
+    {
+      return std::to_string (bytes >> 20) + "m";
+    }
+  if (bytes % (1 << 10) == 0)
+    {
+      return std::to_string (bytes >> 10) + "k";
+    }
+  return std::to_string (bytes) + "b";
+}
 
-  double func = osm_function_time (200000);
+/**
+ * Helper function that builds the registry of all the benchmarks
+ * @return the benchmarks, in the order they are run
+ */
+static std::vector<Benchmark> make_benchmarks ()
+{
+  std::vector<Benchmark> benchmarks;
+  benchmarks.push_back ({"operation", "ns", nullptr,
+                         [] (const osm_config *config, osm_results *results, double *)
+                         {
+                           return osm_operation_stats (config, results);
+                         }});
+  benchmarks.push_back ({"function", "ns", nullptr,
+                         [] (const osm_config *config, osm_results *results, double *)
+                         {
+                           return osm_function_stats (config, results);
+                         }});
+  benchmarks.push_back ({"syscall", "ns", nullptr,
+                         [] (const osm_config *config, osm_results *results, double *)
+                         {
+                           return osm_syscall_stats (config, results);
+                         }});
+  for (int path = 0; path < OSM_SYSCALL_PATH_COUNT; path++)
+    {
+      benchmarks.push_back ({std::string ("syscall/") + osm_syscall_path_name ((osm_syscall_path) path), "ns", nullptr,
+                             [path] (const osm_config *config, osm_results *results, double *)
+                             {
+                               return osm_syscall_path_stats ((osm_syscall_path) path, config, results);
+                             }});
+    }
+  for (int kind = 0; kind < OSM_SWITCH_KIND_COUNT; kind++)
+    {
+      for (int placement: {OSM_SAME_CORE, OSM_CROSS_CORE})
+        {
+          if ((kind == OSM_SWITCH_SIGJMP_MASK || kind == OSM_SWITCH_SIGJMP_NOMASK) && placement == OSM_CROSS_CORE)
+            {
+              continue;
+            }
+          std::string name = std::string ("switch/") + osm_switch_name ((osm_switch_kind) kind)
+                             + (placement == OSM_SAME_CORE ? "/same_core" : "/cross_core");
+          benchmarks.push_back ({name, "ns", nullptr,
+                                 [kind, placement] (const osm_config *config, osm_results *results, double *)
+                                 {
+                                   return osm_switch_stats ((osm_switch_kind) kind, (osm_placement) placement,
+                                                            config, results);
+                                 }});
+        }
+    }
+  for (int kind = 0; kind < OSM_SIGNAL_KIND_COUNT; kind++)
+    {
+      for (int placement: {OSM_SAME_CORE, OSM_CROSS_CORE})
+        {
+          if (kind == OSM_SIGNAL_SELF && placement == OSM_CROSS_CORE)
+            {
+              continue;
+            }
+          std::string name = std::string ("signal/") + osm_signal_name ((osm_signal_kind) kind)
+                             + (placement == OSM_SAME_CORE ? "/same_core" : "/cross_core");
+          benchmarks.push_back ({name, "ns", nullptr,
+                                 [kind, placement] (const osm_config *config, osm_results *results, double *)
+                                 {
+                                   return osm_signal_stats ((osm_signal_kind) kind, (osm_placement) placement,
+                                                            config, results);
+                                 }});
+        }
+    }
+  for (int timer = 0; timer < OSM_INTERVAL_TIMER_COUNT; timer++)
+    {
+      for (unsigned int quantum_us = MIN_QUANTUM_US; quantum_us <= MAX_QUANTUM_US; quantum_us *= 10)
+        {
+          std::string name = std::string ("timer/") + osm_interval_timer_name ((osm_interval_timer) timer)
+                             + "/" + std::to_string (quantum_us) + "us";
+          /* about a second of expirations, within bounds */
+          unsigned int ticks = std::min (MAX_TICKS, std::max (MIN_TICKS, US_PER_SEC / quantum_us));
+          benchmarks.push_back ({name, "ns_error", "tick_cost_ns",
+                                 [timer, quantum_us, ticks] (const osm_config *, osm_results *results,
+                                                             double *extra)
+                                 {
+                                   return osm_timer_jitter ((osm_interval_timer) timer, quantum_us, ticks,
+                                                            results, extra);
+                                 }});
+        }
+    }
+  int spawn_loads[] = {0, osm_cpu_count () > 0 ? osm_cpu_count () : 1};
+  for (int kind = 0; kind < OSM_SPAWN_KIND_COUNT; kind++)
+    {
+      bool stacked = kind == OSM_SPAWN_PTHREAD || kind == OSM_SPAWN_CLONE || kind == OSM_SPAWN_CLONE_NS
+                     || kind == OSM_SPAWN_UTHREAD;
+      for (size_t stack_size: {SMALL_STACK_BYTES, LARGE_STACK_BYTES})
+        {
+          if (!stacked && stack_size != SMALL_STACK_BYTES)
+            {
+              continue;
+            }
+          for (int load: spawn_loads)
+            {
+              std::string name = std::string ("spawn/") + osm_spawn_name ((osm_spawn_kind) kind)
+                                 + (stacked ? "/" + std::to_string (stack_size >> 10) + "k" : "")
+                                 + "/load" + std::to_string (load);
+              benchmarks.push_back ({name, "ns", nullptr,
+                                     [kind, stack_size, load] (const osm_config *config, osm_results *results,
+                                                               double *)
+                                     {
+                                       return osm_spawn_stats ((osm_spawn_kind) kind, stack_size, load,
+                                                               config, results);
+                                     }});
+            }
+        }
+    }
+  size_t ipc_sizes[] = {8, 64, 512, 4 << 10, 32 << 10, 256 << 10, OSM_MAX_IPC_MESSAGE};
+  for (int transport = 0; transport < OSM_IPC_TRANSPORT_COUNT; transport++)
+    {
+      for (int mode: {OSM_IPC_ROUND_TRIP, OSM_IPC_STREAM})
+        {
+          for (size_t bytes: ipc_sizes)
+            {
+              std::string name = std::string ("ipc/") + osm_ipc_name ((osm_ipc_transport) transport)
+                                 + (mode == OSM_IPC_ROUND_TRIP ? "/round_trip/" : "/stream/")
+                                 + size_name (bytes);
+              benchmarks.push_back ({name, "ns", "bytes_per_sec",
+                                     [transport, mode, bytes] (const osm_config *config, osm_results *results,
+                                                               double *extra)
+                                     {
+                                       return osm_ipc_stats ((osm_ipc_transport) transport, (osm_ipc_mode) mode,
+                                                             bytes, config, results, extra);
+                                     }});
+            }
+        }
+    }
+  for (size_t bytes = MIN_LATENCY_BYTES; bytes <= MAX_LATENCY_BYTES; bytes *= 4)
+    {
+      benchmarks.push_back ({"memory/latency/" + std::to_string (bytes >> 10) + "k", "ns", nullptr,
+                             [bytes] (const osm_config *config, osm_results *results, double *)
+                             {
+                               return osm_memory_latency_stats (bytes, config, results);
+                             }});
+    }
+  for (int kind = 0; kind < OSM_BANDWIDTH_KIND_COUNT; kind++)
+    {
+      benchmarks.push_back ({std::string ("memory/bandwidth/") + osm_bandwidth_name ((osm_bandwidth_kind) kind),
+                             "ns/byte", nullptr,
+                             [kind] (const osm_config *config, osm_results *results, double *)
+                             {
+                               return osm_bandwidth_stats ((osm_bandwidth_kind) kind, BANDWIDTH_BYTES,
+                                                           config, results);
+                             }});
+    }
+  for (int kind = 0; kind < OSM_PAGING_KIND_COUNT; kind++)
+    {
+      for (int page_size: {OSM_PAGE_4K, OSM_PAGE_THP})
+        {
+          bool fault = kind == OSM_PAGING_MINOR_FAULT || kind == OSM_PAGING_MAJOR_FAULT;
+          if (page_size == OSM_PAGE_THP && (kind == OSM_PAGING_MAJOR_FAULT || kind == OSM_PAGING_MMAP_MUNMAP))
+            {
+              continue;
+            }
+          std::string name = std::string ("paging/") + osm_paging_name ((osm_paging_kind) kind)
+                             + (page_size == OSM_PAGE_4K ? "/4k" : "/thp");
+          benchmarks.push_back ({name, fault ? "ns/page" : "ns", nullptr,
+                                 [kind, page_size] (const osm_config *config, osm_results *results, double *)
+                                 {
+                                   return osm_paging_stats ((osm_paging_kind) kind, (osm_page_size) page_size,
+                                                            PAGING_BYTES, config, results);
+                                 }});
+        }
+    }
+  int cpus = osm_cpu_count ();
+  for (int kind = 0; kind < OSM_CONTENTION_KIND_COUNT; kind++)
+    {
+      for (int threads = 1; threads == 1 || (threads <= cpus && threads <= OSM_MAX_CONTENTION_THREADS);
+           threads *= 2)
+        {
+          std::string name = std::string ("contention/") + osm_contention_name ((osm_contention_kind) kind)
+                             + "/" + std::to_string (threads);
+          benchmarks.push_back ({name, "ns", "ops_per_sec",
+                                 [kind, threads] (const osm_config *config, osm_results *results, double *extra)
+                                 {
+                                   return osm_contention_stats ((osm_contention_kind) kind, threads,
+                                                                config, results, extra);
+                                 }});
+        }
+    }
+  for (int kernel = 0; kernel < OSM_KERNEL_COUNT; kernel++)
+    {
+      for (int mode: {OSM_CHAIN_DEPENDENT, OSM_CHAIN_INDEPENDENT})
+        {
+          std::string name = std::string ("kernel/") + osm_kernel_name ((osm_kernel) kernel)
+                             + (mode == OSM_CHAIN_DEPENDENT ? "/latency" : "/throughput");
+          benchmarks.push_back ({name, "ns", nullptr,
+                                 [kernel, mode] (const osm_config *config, osm_results *results, double *)
+                                 {
+                                   return osm_kernel_stats ((osm_kernel) kernel, (osm_chain_mode) mode,
+                                                            config, results);
+                                 }});
+        }
+    }
+  return benchmarks;
+}
 
-//  double syscall = osm_syscall_time (200000);
+/**
+ * Helper function that checks whether a benchmark is selected. A filter is
+ * a shell pattern matching the whole name or one of its leading groups, so
+ * "syscall" selects "syscall" and "syscall/getpid", and "*futex*" selects
+ * every futex switch.
+ * @param name name of the benchmark
+ * @param filters the filters, all the benchmarks are selected if empty
+ * @return true if the benchmark is selected, false otherwise.
+ */
+static bool selected (const std::string &name, const std::vector<std::string> &filters)
+{
+  if (filters.empty ())
+    {
+      return true;
+    }
+  for (const std::string &filter: filters)
+    {
+      if (fnmatch (filter.c_str (), name.c_str (), 0) == 0
+          || fnmatch ((filter + "/*").c_str (), name.c_str (), 0) == 0)
+        {
+          return true;
+        }
+    }
+  return false;
+}
 
-  std::cout << "simple_arithmetic: " << op << "\n" <<
-            "function: " << func << "\n" << "syscall: "
+/**
+ * Helper function that prints the usage of the command line
+ * @param program name of the program
+ */
+static void usage (const char *program)
+{
+  std::cerr << "usage: " << program << " [options]\n"
+            << "  --list               print the benchmark names and exit\n"
+            << "  --filter PATTERN     run only matching benchmarks (shell pattern,\n"
+            << "                       a prefix of '/' groups matches the group,\n"
+            << "                       comma separated or repeated)\n"
+            << "  --format FORMAT      text (default), json or csv\n"
+            << "  --output FILE        write the results to FILE instead of stdout\n"
+            << "  --baseline FILE      compare against results saved with --format csv\n"
+            << "  --threshold PERCENT  smallest relative change reported (default 5)\n"
+            << "  --timer TIMER        gettimeofday, monotonic_raw (default) or tsc\n"
+            << "  --counters           collect hardware performance counters\n"
+            << "  --quick              fewer trials and a looser confidence target\n"
+            << "exits with " << EXIT_REGRESSION << " if a benchmark regressed against the baseline"
             << std::endl;
+}
 
+/**
+ * Helper function that parses the command line
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options output
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int parse_options (int argc, char *argv[], Options *options)
+{
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (arg == "--list")
+        {
+          options->list = true;
+        }
+      else if (arg == "--quick")
+        {
+          options->quick = true;
+        }
+      else if (arg == "--counters")
+        {
+          options->counters = true;
+        }
+      else if (!has_value)
+        {
+          return -1;
+        }
+      else if (arg == "--filter")
+        {
+          std::stringstream patterns (argv[++i]);
+          std::string pattern;
+          while (std::getline (patterns, pattern, ','))
+            {
+              if (!pattern.empty ())
+                {
+                  options->filters.push_back (pattern);
+                }
+            }
+        }
+      else if (arg == "--format")
+        {
+          options->format = argv[++i];
+          if (options->format != "text" && options->format != "json" && options->format != "csv")
+            {
+              return -1;
+            }
+        }
+      else if (arg == "--output")
+        {
+          options->output = argv[++i];
+        }
+      else if (arg == "--baseline")
+        {
+          options->baseline = argv[++i];
+        }
+      else if (arg == "--timer")
+        {
+          options->timer = argv[++i];
+        }
+      else if (arg == "--threshold")
+        {
+          char *end;
+          options->threshold = std::strtod (argv[++i], &end) / PERCENT;
+          if (*end != '\0' || options->threshold < 0)
+            {
+              return -1;
+            }
+        }
+      else
+        {
+          return -1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Helper function that selects the timing engine by name
+ * @param name name of the engine
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int set_timer (const std::string &name)
+{
+  for (int timer = 0; timer < (int) (sizeof (TIMER_NAMES) / sizeof (TIMER_NAMES[0])); timer++)
+    {
+      if (name == TIMER_NAMES[timer])
+        {
+          return osm_set_timer ((osm_timer) timer);
+        }
+    }
+  return -1;
+}
+
+/**
+ * Helper function that splits a CSV line (the names never contain commas)
+ * @param line the line
+ * @return the fields
+ */
+static std::vector<std::string> split_csv (const std::string &line)
+{
+  std::vector<std::string> fields;
+  std::stringstream stream (line);
+  std::string field;
+  while (std::getline (stream, field, ','))
+    {
+      fields.push_back (field);
+    }
+  if (!line.empty () && line.back () == ',')
+    {
+      fields.push_back ("");
+    }
+  return fields;
+}
+
+/**
+ * Helper function that reads results saved with --format csv. Rows of failed
+ * benchmarks and unknown columns are ignored.
+ * @param path path of the file
+ * @param baseline output, results by benchmark name
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int read_baseline (const std::string &path, std::map<std::string, osm_results> *baseline)
+{
+  std::ifstream file (path);
+  std::string line;
+  if (!file || !std::getline (file, line))
+    {
+      return -1;
+    }
+  std::map<std::string, size_t> columns;
+  std::vector<std::string> header = split_csv (line);
+  for (size_t column = 0; column < header.size (); column++)
+    {
+      columns[header[column]] = column;
+    }
+  for (const char *required: {"name", "trials", "median", "mean", "stddev"})
+    {
+      if (columns.count (required) == 0)
+        {
+          return -1;
+        }
+    }
+  while (std::getline (file, line))
+    {
+      std::vector<std::string> fields = split_csv (line);
+      if (fields.size () != header.size ())
+        {
+          continue;
+        }
+      auto value = [&] (const char *column)
+      {
+        return columns.count (column) ? std::strtod (fields[columns[column]].c_str (), nullptr) : 0;
+      };
+      osm_results results{};
+      results.iterations = (unsigned int) value ("iterations");
+      results.trials = (unsigned int) value ("trials");
+      results.rejected = (unsigned int) value ("rejected");
+      results.min = value ("min");
+      results.median = value ("median");
+      results.mean = value ("mean");
+      results.p90 = value ("p90");
+      results.p99 = value ("p99");
+      results.max = value ("max");
+      results.stddev = value ("stddev");
+      results.ci95 = value ("ci95");
+      if (results.trials > 0)
+        {
+          (*baseline)[fields[columns["name"]]] = results;
+        }
+    }
   return 0;
 }
+
+/**
+ * Helper function that finds the relative change of the mean
+ * @param outcome a compared outcome
+ * @return the change in percents
+ */
+static double change_percent (const Outcome &outcome)
+{
+  return outcome.baseline.mean > 0
+         ? PERCENT * (outcome.results.mean - outcome.baseline.mean) / outcome.baseline.mean : 0;
+}
+
+/**
+ * Helper function that finds the status of an outcome
+ * @param outcome the outcome
+ * @param has_baseline whether a baseline was given
+ * @return failed, ok (no baseline), new (not in the baseline) or the change
+ */
+static const char *status_of (const Outcome &outcome, bool has_baseline)
+{
+  if (!outcome.measured)
+    {
+      return "failed";
+    }
+  if (!has_baseline)
+    {
+      return "ok";
+    }
+  return outcome.compared ? CHANGE_NAMES[outcome.change] : "new";
+}
+
+/**
+ * Helper function that prints the outcomes as an aligned table
+ * @param out the stream
+ * @param outcomes the outcomes
+ * @param has_baseline whether a baseline was given
+ */
+static void print_text (std::ostream &out, const std::vector<Outcome> &outcomes, bool has_baseline)
+{
+  out << std::left << std::setw (34) << "benchmark" << std::right << std::setw (12) << "median"
+      << std::setw (12) << "p99" << std::setw (12) << "stddev" << std::setw (12) << "ci95"
+      << std::setw (10) << "cycles" << std::setw (10) << "instr";
+  if (has_baseline)
+    {
+      out << std::setw (12) << "baseline" << std::setw (10) << "change" << std::setw (11) << "status";
+    }
+  out << std::endl;
+  for (const Outcome &outcome: outcomes)
+    {
+      out << std::left << std::setw (34) << outcome.benchmark->name << std::right << std::fixed
+          << std::setprecision (3);
+      if (!outcome.measured)
+        {
+          out << std::setw (12) << "failed" << std::endl;
+          continue;
+        }
+      const osm_results &results = outcome.results;
+      out << std::setw (12) << results.median << std::setw (12) << results.p99
+          << std::setw (12) << results.stddev << std::setw (12) << results.ci95
+          << std::setprecision (2);
+      for (int counter: {OSM_COUNTER_CYCLES, OSM_COUNTER_INSTRUCTIONS})
+        {
+          if (results.counter_valid[counter])
+            {
+              out << std::setw (10) << results.counters[counter];
+            }
+          else
+            {
+              out << std::setw (10) << "-";
+            }
+        }
+      if (has_baseline && outcome.compared)
+        {
+          out << std::setprecision (3) << std::setw (12) << outcome.baseline.median
+              << std::setprecision (1) << std::showpos << std::setw (9) << change_percent (outcome)
+              << "%" << std::noshowpos << std::setw (11) << status_of (outcome, has_baseline);
+        }
+      else if (has_baseline)
+        {
+          out << std::setw (12) << "-" << std::setw (10) << "-" << std::setw (11)
+              << status_of (outcome, has_baseline);
+        }
+      if (outcome.benchmark->extra != nullptr)
+        {
+          out << "  " << outcome.benchmark->extra << "=" << std::setprecision (0) << outcome.extra;
+        }
+      out << std::endl;
+    }
+}
+
+/**
+ * Helper function that prints the outcomes as CSV, one row per benchmark.
+ * The output of a run can be given back as --baseline.
+ * @param out the stream
+ * @param outcomes the outcomes
+ * @param has_baseline whether a baseline was given
+ */
+static void print_csv (std::ostream &out, const std::vector<Outcome> &outcomes, bool has_baseline)
+{
+  out << "name,unit,status,iterations,trials,rejected,min,median,mean,p90,p99,max,stddev,ci95";
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      out << "," << osm_counter_name ((osm_counter) counter);
+    }
+  out << ",extra_name,extra";
+  if (has_baseline)
+    {
+      out << ",baseline_median,baseline_mean,change_percent";
+    }
+  out << "\n" << std::setprecision (6);
+  for (const Outcome &outcome: outcomes)
+    {
+      const osm_results &results = outcome.results;
+      out << outcome.benchmark->name << "," << outcome.benchmark->unit << ","
+          << status_of (outcome, has_baseline);
+      if (outcome.measured)
+        {
+          out << "," << results.iterations << "," << results.trials << "," << results.rejected
+              << "," << results.min << "," << results.median << "," << results.mean
+              << "," << results.p90 << "," << results.p99 << "," << results.max
+              << "," << results.stddev << "," << results.ci95;
+        }
+      else
+        {
+          out << ",,,,,,,,,,,";
+        }
+      for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+        {
+          out << ",";
+          if (outcome.measured && results.counter_valid[counter])
+            {
+              out << results.counters[counter];
+            }
+        }
+      out << "," << (outcome.benchmark->extra != nullptr ? outcome.benchmark->extra : "") << ",";
+      if (outcome.measured && outcome.benchmark->extra != nullptr)
+        {
+          out << outcome.extra;
+        }
+      if (has_baseline)
+        {
+          if (outcome.measured && outcome.compared)
+            {
+              out << "," << outcome.baseline.median << "," << outcome.baseline.mean
+                  << "," << change_percent (outcome);
+            }
+          else
+            {
+              out << ",,,";
+            }
+        }
+      out << "\n";
+    }
+  out.flush ();
+}
+
+/**
+ * Helper function that prints the outcomes as a JSON document
+ * @param out the stream
+ * @param outcomes the outcomes
+ * @param has_baseline whether a baseline was given
+ */
+static void print_json (std::ostream &out, const std::vector<Outcome> &outcomes, bool has_baseline)
+{
+  out << "{\n  \"timer\": \"" << TIMER_NAMES[osm_get_timer ()] << "\",\n  \"benchmarks\": [";
+  out << std::setprecision (6);
+  for (size_t i = 0; i < outcomes.size (); i++)
+    {
+      const Outcome &outcome = outcomes[i];
+      const osm_results &results = outcome.results;
+      out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << outcome.benchmark->name
+          << "\", \"unit\": \"" << outcome.benchmark->unit << "\", \"status\": \""
+          << status_of (outcome, has_baseline) << "\"";
+      if (outcome.measured)
+        {
+          out << ", \"iterations\": " << results.iterations << ", \"trials\": " << results.trials
+              << ", \"rejected\": " << results.rejected << ", \"min\": " << results.min
+              << ", \"median\": " << results.median << ", \"mean\": " << results.mean
+              << ", \"p90\": " << results.p90 << ", \"p99\": " << results.p99
+              << ", \"max\": " << results.max << ", \"stddev\": " << results.stddev
+              << ", \"ci95\": " << results.ci95 << ", \"counters\": {";
+          const char *separator = "";
+          for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+            {
+              if (results.counter_valid[counter])
+                {
+                  out << separator << "\"" << osm_counter_name ((osm_counter) counter) << "\": "
+                      << results.counters[counter];
+                  separator = ", ";
+                }
+            }
+          out << "}";
+          if (outcome.benchmark->extra != nullptr)
+            {
+              out << ", \"" << outcome.benchmark->extra << "\": " << outcome.extra;
+            }
+          if (outcome.compared)
+            {
+              out << ", \"baseline\": {\"median\": " << outcome.baseline.median
+                  << ", \"mean\": " << outcome.baseline.mean << ", \"change_percent\": "
+                  << change_percent (outcome) << "}";
+            }
+        }
+      out << "}";
+    }
+  out << "\n  ]\n}" << std::endl;
+}
+
+int main (int argc, char *argv[])
+{
+  Options options;
+  if (parse_options (argc, argv, &options) != 0)
+    {
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  std::vector<Benchmark> benchmarks = make_benchmarks ();
+  if (options.list)
+    {
+      for (const Benchmark &benchmark: benchmarks)
+        {
+          if (selected (benchmark.name, options.filters))
+            {
+              std::cout << benchmark.name << std::endl;
+            }
+        }
+      return EXIT_SUCCESS;
+    }
+
+  if (!options.timer.empty () && set_timer (options.timer) != 0)
+    {
+      std::cerr << "timer " << options.timer << " is not supported" << std::endl;
+      return EXIT_FAILURE;
+    }
+  std::map<std::string, osm_results> baseline;
+  bool has_baseline = !options.baseline.empty ();
+  if (has_baseline && read_baseline (options.baseline, &baseline) != 0)
+    {
+      std::cerr << "cannot read the baseline " << options.baseline << std::endl;
+      return EXIT_FAILURE;
+    }
+  /* opened before the run, so that a bad path does not throw a long run away */
+  std::ofstream file;
+  if (!options.output.empty ())
+    {
+      file.open (options.output);
+      if (!file)
+        {
+          std::cerr << "cannot write " << options.output << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  if (options.counters && osm_set_counters (true) != 0)
+    {
+      std::cerr << "hardware counters are not available, measuring time only" << std::endl;
+    }
+  osm_config config{};
+  osm_default_config (&config);
+  if (options.quick)
+    {
+      config.min_trials = QUICK_MIN_TRIALS;
+      config.max_trials = QUICK_MAX_TRIALS;
+      config.target_ci = QUICK_TARGET_CI;
+    }
+
+  std::vector<Outcome> outcomes;
+  bool regressed = false;
+  for (const Benchmark &benchmark: benchmarks)
+    {
+      if (!selected (benchmark.name, options.filters))
+        {
+          continue;
+        }
+      Outcome outcome{};
+      outcome.benchmark = &benchmark;
+      outcome.measured = benchmark.run (&config, &outcome.results, &outcome.extra) == 0;
+      auto stored = baseline.find (benchmark.name);
+      if (outcome.measured && stored != baseline.end ())
+        {
+          outcome.compared = true;
+          outcome.baseline = stored->second;
+          outcome.change = osm_compare (&outcome.baseline, &outcome.results, options.threshold);
+          regressed = regressed || outcome.change == OSM_REGRESSED;
+        }
+      outcomes.push_back (outcome);
+    }
+
+  std::ostream &out = options.output.empty () ? std::cout : file;
+  if (options.format == "json")
+    {
+      print_json (out, outcomes, has_baseline);
+    }
+  else if (options.format == "csv")
+    {
+      print_csv (out, outcomes, has_baseline);
+    }
+  else
+    {
+      print_text (out, outcomes, has_baseline);
+    }
+  osm_set_counters (false);
+  return regressed ? EXIT_REGRESSION : EXIT_SUCCESS;
+}
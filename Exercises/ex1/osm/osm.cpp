@@ -1,48 +1,58 @@
-#include <sys/time.h>
-#include <utility>
+#include <stdint.h>
 #include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+#include "osm_kernels.h"
 
-#define SEC_TO_NANO 1000000000
-#define MIK_TO_NANO 1000
 #define FAIL -1
 #define UNROLLING_FACTOR 5
+#define OVERHEAD_RUNS 3
+
+static bool subtract_overhead = true;
 
 
 /**
  * Enum for assigning different operation
  */
 enum Operation {
-    ARITHMETIC, FUNCTION, TRAP
+    EMPTY, ARITHMETIC, FUNCTION, TRAP
 };
 
 /**
- * Empty function
+ * Empty function. It is kept out of line, and the barrier keeps the compiler
+ * from proving that calling it has no effect.
  */
-void empty_func_call ()
-{}
+__attribute__((noinline)) void empty_func_call ()
+{
+  osm_clobber ();
+}
 
 /**
  * Helper function that runs the actual operation defined by the user
  * @param operation Enum for the specific operation
- * @param iterations Number of iterations
+ * @param rounds Number of rounds, each of UNROLLING_FACTOR operations
  * @return A double that has no real significance
  */
-double make_operations (Operation operation, unsigned int iterations)
+double make_operations (Operation operation, unsigned int rounds)
 {
   switch (operation)
     {
-      case ARITHMETIC:
+      case EMPTY:
         {
-          int x = 0, y = 0, z = 0, w = 1, t = 1, k = 1;
-          for (unsigned int i = iterations; i > 0; i -= UNROLLING_FACTOR)
+          for (unsigned int i = 0; i < rounds; i++)
             {
-              x = x + y + z + w + t + k;
+              osm_clobber ();
             }
-          return x;
+          return 0;
+        }
+      case ARITHMETIC:
+        {
+          return osm_dependent_chain<int, OsmAdd, UNROLLING_FACTOR> (rounds, 0, 1);
         }
       case FUNCTION:
         {
-          for (unsigned int i = iterations; i > 0; i -= UNROLLING_FACTOR)
+          for (unsigned int i = 0; i < rounds; i++)
             {
               empty_func_call ();
               empty_func_call ();
@@ -54,7 +64,7 @@ double make_operations (Operation operation, unsigned int iterations)
         }
       case TRAP:
         {
-          for (unsigned int i = iterations; i > 0; i -= UNROLLING_FACTOR)
+          for (unsigned int i = 0; i < rounds; i++)
             {
               OSM_NULLSYSCALL;
               OSM_NULLSYSCALL;
@@ -69,7 +79,59 @@ double make_operations (Operation operation, unsigned int iterations)
 }
 
 /**
- * Helper function that operates the time counting of the operation
+ * Helper function that times a single run of the operation with the
+ * selected timing engine
+ * @param op The specified operation Enum
+ * @param rounds Number of rounds of UNROLLING_FACTOR operations
+ * @return The measured time of the whole run in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+double time_operations (Operation op, unsigned int rounds)
+{
+  uint64_t start = osm_region_begin ();
+  make_operations (op, rounds);
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/**
+ * Helper function that measures the cost of the bare loop around the
+ * operations, taking the fastest of a few runs so that an interrupt in
+ * one of them does not inflate the correction. The runs are timed outside
+ * of a region, so they do not add to the hardware counters.
+ * @param rounds Number of rounds of UNROLLING_FACTOR operations
+ * @return The loop overhead of the whole run in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+double loop_overhead (unsigned int rounds)
+{
+  double best = FAIL;
+  for (int run = 0; run < OVERHEAD_RUNS; run++)
+    {
+      uint64_t start = osm_timer_read ();
+      make_operations (EMPTY, rounds);
+      uint64_t end = osm_timer_read ();
+      if (start == 0 || end == 0)
+        {
+          return FAIL;
+        }
+      double elapsed = osm_timer_elapsed_ns (start, end);
+      if (best == FAIL || elapsed < best)
+        {
+          best = elapsed;
+        }
+    }
+  return best;
+}
+
+/**
+ * Helper function that operates the time counting of the operation. The
+ * iterations are rounded up to whole rounds of UNROLLING_FACTOR operations,
+ * and the time is divided by the number of operations actually run.
  * @param op The specified operation Enum
  * @param iterations Number of iterations
  * @return The measured time of the operation in Nano-seconds in case of
@@ -81,47 +143,121 @@ double get_run_time (Operation op, unsigned int iterations)
     {
       return FAIL;
     }
-  std::pair<int, int> times;
-  struct timeval start{}, end{};
-  times.first = gettimeofday (&start, nullptr);
-  make_operations (op, iterations);
-  times.second = gettimeofday (&end, nullptr);
-  if (times.first == FAIL || times.second == FAIL)
+  unsigned int rounds = (iterations + UNROLLING_FACTOR - 1) / UNROLLING_FACTOR;
+  double elapsed = time_operations (op, rounds);
+  if (elapsed == FAIL)
     {
       return FAIL;
     }
-  return (double) ((end.tv_sec * SEC_TO_NANO + (end.tv_usec) * MIK_TO_NANO)
-                   - (start.tv_sec * SEC_TO_NANO
-                      + start.tv_usec * MIK_TO_NANO)) / iterations;
+  if (subtract_overhead)
+    {
+      double overhead = loop_overhead (rounds);
+      if (overhead == FAIL)
+        {
+          return FAIL;
+        }
+      elapsed = elapsed > overhead ? elapsed - overhead : 0;
+    }
+  return elapsed / ((double) rounds * UNROLLING_FACTOR);
+}
+
+void osm_set_overhead_subtraction (bool enable)
+{
+  subtract_overhead = enable;
 }
 
 /**
- * implementation of the arithmetic operation function
+ * Harness trial that runs the operation pointed to by arg
  * @param iterations Number of iterations
+ * @param arg Pointer to the Operation Enum
  * @return The measured time of the operation in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+double operation_trial (unsigned int iterations, void *arg)
+{
+  return get_run_time (*(Operation *) arg, iterations);
+}
+
+/**
+ * Helper function that runs the harness on an operation
+ * @param op The specified operation Enum
+ * @param config harness configuration
+ * @param results output statistics
+ * @return 0 in case of success, -1 otherwise.
+ */
+int get_run_stats (Operation op, const osm_config *config, osm_results *results)
+{
+  return osm_measure (&operation_trial, &op, config, results);
+}
+
+/**
+ * Helper function that keeps the single number interface: runs the default
+ * trials with a fixed number of iterations and reports their median
+ * @param op The specified operation Enum
+ * @param iterations Number of iterations
+ * @return The median time of the operation in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+double get_median_run_time (Operation op, unsigned int iterations)
+{
+  if (iterations <= 0)
+    {
+      return FAIL;
+    }
+  osm_config config{};
+  osm_default_config (&config);
+  config.iterations = iterations;
+  config.adaptive = false;
+  osm_results results{};
+  if (get_run_stats (op, &config, &results) == FAIL)
+    {
+      return FAIL;
+    }
+  return results.median;
+}
+
+int osm_operation_stats (const osm_config *config, osm_results *results)
+{
+  return get_run_stats (ARITHMETIC, config, results);
+}
+
+int osm_function_stats (const osm_config *config, osm_results *results)
+{
+  return get_run_stats (FUNCTION, config, results);
+}
+
+int osm_syscall_stats (const osm_config *config, osm_results *results)
+{
+  return get_run_stats (TRAP, config, results);
+}
+
+/**
+ * implementation of the arithmetic operation function
+ * @param iterations Number of iterations
+ * @return The median measured time of the operation in Nano-seconds in case of
  * success, -1 otherwise. */
 double osm_operation_time (unsigned int iterations)
 {
-  return get_run_time (ARITHMETIC, iterations);
+  return get_median_run_time (ARITHMETIC, iterations);
 }
 
 /**
  * implementation of the empty function operation
  * @param iterations Number of iterations
- * @return The measured time of the operation in Nano-seconds in case of
+ * @return The median measured time of the operation in Nano-seconds in case of
  * success, -1 otherwise. */
 double osm_function_time (unsigned int iterations)
 {
-  return get_run_time (FUNCTION, iterations);
+  return get_median_run_time (FUNCTION, iterations);
 }
 
 /**
  * implementation of the syscall operation function
  * @param iterations Number of iterations
- * @return The measured time of the operation in Nano-seconds in case of
+ * @return The median measured time of the operation in Nano-seconds in case of
  * success, -1 otherwise. */
 double osm_syscall_time (unsigned int iterations)
 {
-  return get_run_time (TRAP, iterations);
+  return get_median_run_time (TRAP, iterations);
 }
 
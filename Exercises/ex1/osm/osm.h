@@ -1,32 +1,602 @@
 #ifndef _OSM_H
 #define _OSM_H
 
+#include <stddef.h>
+
 
 /* calling a system call that does nothing */
+#if defined(__x86_64__)
+/* the 64-bit kernel entry, syscall clobbers rcx and r11 */
+#define OSM_NULLSYSCALL do { long _osm_ret; \
+        asm volatile( "syscall" : "=a" (_osm_ret) : \
+        "0" (0x7fffffffL) /* no such syscall */ : "rcx", "r11", "memory"); \
+        (void) _osm_ret; } while (0)
+#else
 #define OSM_NULLSYSCALL asm volatile( "int $0x80 " : : \
         "a" (0xffffffff) /* no such syscall */, "b" (0), "c" (0), "d" (0) /*:\
         "eax", "ebx", "ecx", "edx"*/)
+#endif
+
+
+/* Timing engines that can be used for the measurements:
+   OSM_TIMER_GETTIMEOFDAY - wall clock with micro-second resolution.
+   OSM_TIMER_MONOTONIC_RAW - clock_gettime(CLOCK_MONOTONIC_RAW), not
+                             affected by NTP adjustments.
+   OSM_TIMER_TSC - serialized rdtscp, converted to nano-seconds using a
+                   frequency calibrated against CLOCK_MONOTONIC_RAW.
+   */
+enum osm_timer {
+    OSM_TIMER_GETTIMEOFDAY, OSM_TIMER_MONOTONIC_RAW, OSM_TIMER_TSC
+};
+
+
+/* Selects the timing engine used by all the following measurements.
+   The default engine is OSM_TIMER_MONOTONIC_RAW.
+   returns 0 upon success,
+   and -1 upon failure (e.g. the engine is not supported on this machine).
+   */
+int osm_set_timer(osm_timer timer);
+
+
+/* returns the currently selected timing engine. */
+osm_timer osm_get_timer();
+
+
+/* Enables (the default) or disables the subtraction of the empty-loop
+   overhead from the measured per-operation time.
+   */
+void osm_set_overhead_subtraction(bool enable);
+
+
+/* returns the calibrated TSC frequency in ticks per nano-second,
+   and -1 if the TSC is not supported or was not calibrated yet.
+   */
+double osm_tsc_ticks_per_ns();
+
+
+/* Configuration of the statistical measurement harness.
+   warmup_trials - untimed trials run before the measured ones.
+   min_trials, max_trials - bounds on the number of measured trials.
+   iterations - operations per trial (the initial value when adaptive).
+   adaptive - doubles (or halves) iterations until a trial lasts between
+              min_trial_ns and four times min_trial_ns, and keeps
+              adding trials until the 95% confidence interval of the mean is
+              within target_ci (relative) of the mean.
+   outlier_threshold - trials further than this many scaled median absolute
+                       deviations from the median are rejected, 0 disables.
+   */
+struct osm_config {
+    unsigned int warmup_trials;
+    unsigned int min_trials;
+    unsigned int max_trials;
+    unsigned int iterations;
+    bool adaptive;
+    double min_trial_ns;
+    double target_ci;
+    double outlier_threshold;
+};
+
+
+/* Hardware performance counters that can be collected with every
+   measurement, see osm_set_counters.
+   */
+enum osm_counter {
+    OSM_COUNTER_CYCLES, OSM_COUNTER_INSTRUCTIONS, OSM_COUNTER_BRANCH_MISSES,
+    OSM_COUNTER_L1D_MISSES, OSM_COUNTER_LLC_MISSES, OSM_COUNTER_DTLB_MISSES,
+    OSM_COUNTER_COUNT
+};
+
+
+/* Statistics of a measurement, all times are in nano-seconds per operation.
+   ci95 is the half width of the 95% confidence interval of the mean.
+   counters[c] is the average count of counter c per operation over the
+   measured trials, and is meaningful only when counter_valid[c] is set.
+   */
+struct osm_results {
+    unsigned int iterations;
+    unsigned int trials;
+    unsigned int rejected;
+    double min;
+    double median;
+    double mean;
+    double p90;
+    double p99;
+    double max;
+    double stddev;
+    double ci95;
+    bool counter_valid[OSM_COUNTER_COUNT];
+    double counters[OSM_COUNTER_COUNT];
+};
+
+
+/* Enables or disables (the default) the hardware performance counters.
+   The counters are opened with perf_event_open for the calling thread only,
+   so benchmarks that use other threads or processes count just their
+   measuring side, and the counts include the loop overhead.
+   Counters that the kernel refuses (e.g. because of perf_event_paranoid or
+   missing hardware support) are left out, and the measurements fall back to
+   time only when none is available.
+   returns 0 if at least one counter was enabled,
+   and -1 otherwise.
+   */
+int osm_set_counters(bool enable);
+
+
+/* returns a printable name of the counter,
+   and nullptr for an invalid counter.
+   */
+const char *osm_counter_name(osm_counter counter);
+
+
+/* Fills config with the default harness configuration. */
+void osm_default_config(osm_config *config);
+
+
+/* Outcome of comparing a measurement against a baseline measurement. */
+enum osm_change {
+    OSM_UNCHANGED, OSM_IMPROVED, OSM_REGRESSED
+};
+
+
+/* Compares the mean time of current against the one of baseline with
+   Welch's t-test over their kept trials. A change is reported only when it
+   is significant at the 95% level and the means differ by more than
+   threshold (relative to the baseline mean, e.g. 0.05 for 5%).
+   returns the change, OSM_UNCHANGED when either side has less than two
+   trials.
+   */
+osm_change osm_compare(const osm_results *baseline, const osm_results *current,
+                       double threshold);
+
+
+/* Statistical measurement functions of the operations below.
+   fill results according to config.
+   return 0 upon success,
+   and -1 upon failure.
+   */
+int osm_operation_stats(const osm_config *config, osm_results *results);
+int osm_function_stats(const osm_config *config, osm_results *results);
+int osm_syscall_stats(const osm_config *config, osm_results *results);
 
 
 /* Time measurement function for a simple arithmetic operation.
-   returns time in nano-seconds upon success,
+   runs the default trials of the given number of iterations.
+   returns the median time in nano-seconds upon success,
    and -1 upon failure.
    */
 double osm_operation_time(unsigned int iterations);
 
 
 /* Time measurement function for an empty function call.
-   returns time in nano-seconds upon success,
+   runs the default trials of the given number of iterations.
+   returns the median time in nano-seconds upon success,
    and -1 upon failure.
    */
 double osm_function_time(unsigned int iterations);
 
 
 /* Time measurement function for an empty trap into the operating system.
-   returns time in nano-seconds upon success,
+   runs the default trials of the given number of iterations.
+   returns the median time in nano-seconds upon success,
    and -1 upon failure.
    */
 double osm_syscall_time(unsigned int iterations);
 
 
+/* Kernel entry paths measured by the syscall suite:
+   OSM_SYSCALL_INVALID - raw syscall instruction with an invalid number.
+   OSM_SYSCALL_GETPID, OSM_SYSCALL_GETPPID - trivial syscalls through libc.
+   OSM_VDSO_CLOCK_GETTIME, OSM_VDSO_GETTIMEOFDAY - vDSO calls that normally
+                                                  do not enter the kernel.
+   OSM_SYSCALL_PIPE_READ - 1 byte read of a non empty pipe, going through
+                           the file and pipe layers of the kernel.
+   */
+enum osm_syscall_path {
+    OSM_SYSCALL_INVALID, OSM_SYSCALL_GETPID, OSM_SYSCALL_GETPPID,
+    OSM_VDSO_CLOCK_GETTIME, OSM_VDSO_GETTIMEOFDAY, OSM_SYSCALL_PIPE_READ,
+    OSM_SYSCALL_PATH_COUNT
+};
+
+
+/* returns a printable name of the kernel entry path,
+   and nullptr for an invalid path.
+   */
+const char *osm_syscall_path_name(osm_syscall_path path);
+
+
+/* Statistical measurement of a single kernel entry path.
+   returns 0 upon success,
+   and -1 upon failure.
+   */
+int osm_syscall_path_stats(osm_syscall_path path, const osm_config *config,
+                           osm_results *results);
+
+
+/* Measures every kernel entry path, results[path] holds the statistics of
+   each path so they can be reported side by side.
+   returns 0 upon success,
+   and -1 if any of the paths failed.
+   */
+int osm_syscall_suite(const osm_config *config,
+                      osm_results results[OSM_SYSCALL_PATH_COUNT]);
+
+
+/* Context switch paths measured by ping-pong between two contexts:
+   OSM_SWITCH_SIGJMP_MASK - sigsetjmp(env, 1)/siglongjmp between two stacks
+                            of one thread, as done by the uthreads library.
+   OSM_SWITCH_SIGJMP_NOMASK - the same switch without saving the mask.
+   OSM_SWITCH_CONDVAR - handoff between two pthreads with a condition variable.
+   OSM_SWITCH_FUTEX - handoff between two pthreads with a bare futex.
+   OSM_SWITCH_PIPE_PROCESS - handoff between two processes over two pipes.
+   */
+enum osm_switch_kind {
+    OSM_SWITCH_SIGJMP_MASK, OSM_SWITCH_SIGJMP_NOMASK, OSM_SWITCH_CONDVAR,
+    OSM_SWITCH_FUTEX, OSM_SWITCH_PIPE_PROCESS, OSM_SWITCH_KIND_COUNT
+};
+
+
+/* Placement of the two contexts of a switch benchmark:
+   OSM_SAME_CORE - both pinned to the first allowed CPU.
+   OSM_CROSS_CORE - pinned to the first and second allowed CPUs.
+   */
+enum osm_placement {
+    OSM_SAME_CORE, OSM_CROSS_CORE
+};
+
+
+/* returns a printable name of the switch path,
+   and nullptr for an invalid path.
+   */
+const char *osm_switch_name(osm_switch_kind kind);
+
+
+/* Statistical measurement of a context switch path, the results are in
+   nano-seconds per switch (half of a round trip).
+   The sigsetjmp switches never leave their thread, so they support only
+   OSM_SAME_CORE.
+   returns 0 upon success,
+   and -1 upon failure (e.g. OSM_CROSS_CORE on a single CPU).
+   */
+int osm_switch_stats(osm_switch_kind kind, osm_placement placement,
+                     const osm_config *config, osm_results *results);
+
+
+/* Signal delivery paths, SIGUSR1 is caught by an empty handler:
+   OSM_SIGNAL_SELF - raise() in the calling thread, the handler runs before
+                     raise returns.
+   OSM_SIGNAL_THREAD - pthread_kill ping-pong between two threads waiting
+                       in sigsuspend.
+   */
+enum osm_signal_kind {
+    OSM_SIGNAL_SELF, OSM_SIGNAL_THREAD, OSM_SIGNAL_KIND_COUNT
+};
+
+
+/* returns a printable name of the signal delivery path,
+   and nullptr for an invalid path.
+   */
+const char *osm_signal_name(osm_signal_kind kind);
+
+
+/* Statistical measurement of a signal delivery path, the results are in
+   nano-seconds per signal (half of a round trip for OSM_SIGNAL_THREAD).
+   OSM_SIGNAL_SELF supports only OSM_SAME_CORE.
+   returns 0 upon success,
+   and -1 upon failure (e.g. OSM_CROSS_CORE on a single CPU).
+   */
+int osm_signal_stats(osm_signal_kind kind, osm_placement placement,
+                     const osm_config *config, osm_results *results);
+
+
+/* Periodic timers that can drive a preemptive scheduler:
+   OSM_ITIMER_REAL, OSM_ITIMER_VIRTUAL, OSM_ITIMER_PROF - setitimer with
+       SIGALRM, SIGVTALRM and SIGPROF.
+   OSM_POSIX_TIMER - timer_create on CLOCK_MONOTONIC with a real-time signal.
+   OSM_TIMERFD - timerfd_create on CLOCK_MONOTONIC, waited for with read.
+   */
+enum osm_interval_timer {
+    OSM_ITIMER_REAL, OSM_ITIMER_VIRTUAL, OSM_ITIMER_PROF, OSM_POSIX_TIMER,
+    OSM_TIMERFD, OSM_INTERVAL_TIMER_COUNT
+};
+
+
+/* returns a printable name of the interval timer,
+   and nullptr for an invalid timer.
+   */
+const char *osm_interval_timer_name(osm_interval_timer timer);
+
+
+/* Arms the timer with the given period (quantum) and records the time of
+   ticks + 1 consecutive expirations, while the calling thread spins (so that
+   the virtual and profiling timers advance) or, for OSM_TIMERFD, blocks.
+   results are the statistics of the error of every interval (observed
+   minus quantum) in nano-seconds, without outlier rejection, so that the
+   tail of the distribution is kept.
+   tick_cost (if not nullptr) is set to the CPU time taken away from the
+   calling thread by every expiration in nano-seconds: the time its spinning
+   lost for the signal timers, and its CPU time for OSM_TIMERFD. The share
+   of the CPU lost to the timer is about tick_cost / quantum.
+   Uses the handler of the signal of the timer while it runs.
+   returns 0 upon success,
+   and -1 upon failure (e.g. the timer did not fire in time).
+   */
+int osm_timer_jitter(osm_interval_timer timer, unsigned int quantum_us,
+                     unsigned int ticks, osm_results *results, double *tick_cost);
+
+
+/* maximal number of busy threads loading the CPUs during a spawn benchmark */
+#define OSM_MAX_LOAD_THREADS 256
+
+
+/* Ways to start a context that does nothing and to wait for its end:
+   OSM_SPAWN_PTHREAD - pthread_create and pthread_join.
+   OSM_SPAWN_FORK, OSM_SPAWN_VFORK - fork or vfork, _exit and waitpid.
+   OSM_SPAWN_POSIX_SPAWN - posix_spawn of /bin/true and waitpid, so the
+                           exec of a small program is included.
+   OSM_SPAWN_CLONE - clone of a process on its own stack and waitpid.
+   OSM_SPAWN_CLONE_NS - the same in new UTS, PID and mount namespaces, as
+                        done by the container of ex5 (needs CAP_SYS_ADMIN).
+   OSM_SPAWN_UTHREAD - user-level thread as in the uthreads library: a stack
+                       allocated with new, entered with siglongjmp, left
+                       with siglongjmp and deleted.
+   */
+enum osm_spawn_kind {
+    OSM_SPAWN_PTHREAD, OSM_SPAWN_FORK, OSM_SPAWN_VFORK, OSM_SPAWN_POSIX_SPAWN,
+    OSM_SPAWN_CLONE, OSM_SPAWN_CLONE_NS, OSM_SPAWN_UTHREAD, OSM_SPAWN_KIND_COUNT
+};
+
+
+/* returns a printable name of the spawn mechanism,
+   and nullptr for an invalid mechanism.
+   */
+const char *osm_spawn_name(osm_spawn_kind kind);
+
+
+/* Statistical measurement of a spawn mechanism, the results are in
+   nano-seconds per context, from its creation until it was waited for.
+   stack_size is the stack of the new context for OSM_SPAWN_PTHREAD (0 for
+   the default), OSM_SPAWN_CLONE, OSM_SPAWN_CLONE_NS and OSM_SPAWN_UTHREAD,
+   and is ignored by the others.
+   load_threads (0 to OSM_MAX_LOAD_THREADS) busy threads spin during the
+   measurement, to see the cost under concurrent load.
+   returns 0 upon success,
+   and -1 upon failure (e.g. no permission to create namespaces).
+   */
+int osm_spawn_stats(osm_spawn_kind kind, size_t stack_size, int load_threads,
+                    const osm_config *config, osm_results *results);
+
+
+/* largest message of an IPC benchmark */
+#define OSM_MAX_IPC_MESSAGE (1 << 20)
+
+
+/* Transports between two processes, the peer is a forked child:
+   OSM_IPC_PIPE - a pipe per direction.
+   OSM_IPC_UNIX_STREAM - socketpair(AF_UNIX, SOCK_STREAM).
+   OSM_IPC_UNIX_DGRAM - socketpair(AF_UNIX, SOCK_DGRAM), a message is a
+                        single datagram, so large messages need root to
+                        raise the socket buffer.
+   OSM_IPC_TCP - a TCP connection over the loopback, set up like the
+                 sockets of ex5, with TCP_NODELAY.
+   OSM_IPC_EVENTFD - a ring of bytes in shared memory, the reader sleeps on
+                     an eventfd the writer signals after every message.
+   OSM_IPC_SHM_RING - the same single-producer single-consumer ring, both
+                      sides spin instead of sleeping.
+   */
+enum osm_ipc_transport {
+    OSM_IPC_PIPE, OSM_IPC_UNIX_STREAM, OSM_IPC_UNIX_DGRAM, OSM_IPC_TCP,
+    OSM_IPC_EVENTFD, OSM_IPC_SHM_RING, OSM_IPC_TRANSPORT_COUNT
+};
+
+/* OSM_IPC_ROUND_TRIP - a message is sent to the peer and sent back.
+   OSM_IPC_STREAM - messages are sent one after the other, the peer
+                    acknowledges the last one.
+   */
+enum osm_ipc_mode {
+    OSM_IPC_ROUND_TRIP, OSM_IPC_STREAM
+};
+
+
+/* returns a printable name of the transport,
+   and nullptr for an invalid transport.
+   */
+const char *osm_ipc_name(osm_ipc_transport transport);
+
+
+/* Statistical measurement of a transport with messages of message_bytes
+   (1 to OSM_MAX_IPC_MESSAGE) bytes, the results are in nano-seconds per
+   round trip or per streamed message. The setup of the peer is not timed.
+   throughput (may be nullptr) is set to the bytes per second moved at the
+   median of the results, both directions counted for a round trip.
+   returns 0 upon success,
+   and -1 upon failure (e.g. a datagram larger than the socket buffer).
+   */
+int osm_ipc_stats(osm_ipc_transport transport, osm_ipc_mode mode, size_t message_bytes,
+                  const osm_config *config, osm_results *results, double *throughput);
+
+
+/* Streaming bandwidth kernels:
+   OSM_BANDWIDTH_READ - sums the 64-bit words of the buffer.
+   OSM_BANDWIDTH_WRITE - fills the buffer.
+   OSM_BANDWIDTH_COPY - copies the buffer into a second buffer of the same size.
+   */
+enum osm_bandwidth_kind {
+    OSM_BANDWIDTH_READ, OSM_BANDWIDTH_WRITE, OSM_BANDWIDTH_COPY,
+    OSM_BANDWIDTH_KIND_COUNT
+};
+
+
+/* returns a printable name of the bandwidth kernel,
+   and nullptr for an invalid kernel.
+   */
+const char *osm_bandwidth_name(osm_bandwidth_kind kind);
+
+
+/* Load to use latency of a working set of the given size (at least two
+   cache lines). Every cache line of the working set is visited once per
+   lap, in the order of a random cyclic permutation, so that the hardware
+   prefetchers cannot predict the next line.
+   The results are in nano-seconds per load.
+   returns 0 upon success,
+   and -1 upon failure (e.g. the working set could not be allocated).
+   */
+int osm_memory_latency_stats(size_t bytes, const osm_config *config,
+                             osm_results *results);
+
+
+/* Latency curve over working sets doubling from min_bytes up to max_bytes,
+   at most max_points of them. sizes[i] and results[i] hold each point.
+   returns the number of measured points (the curve stops at the first
+   working set that fails, e.g. cannot be allocated),
+   and -1 upon failure of the first point.
+   */
+int osm_memory_latency_curve(size_t min_bytes, size_t max_bytes,
+                             const osm_config *config, size_t sizes[],
+                             osm_results results[], int max_points);
+
+
+/* Streaming bandwidth of a kernel over a buffer of the given size.
+   The results are in nano-seconds per byte (bytes read, written or copied),
+   so the bandwidth in GB/s is 1 / results->median.
+   returns 0 upon success,
+   and -1 upon failure.
+   */
+int osm_bandwidth_stats(osm_bandwidth_kind kind, size_t bytes,
+                        const osm_config *config, osm_results *results);
+
+
+/* Memory management operations:
+   OSM_PAGING_MINOR_FAULT - first write to the pages of fresh anonymous
+                            memory, per 4 KiB page.
+   OSM_PAGING_MAJOR_FAULT - first read of the pages of a file mapping after
+                            the file was dropped from the page cache with
+                            posix_fadvise(POSIX_FADV_DONTNEED), per 4 KiB page.
+   OSM_PAGING_MMAP_MUNMAP - mmap and munmap of anonymous memory that is never
+                            touched, per pair of calls.
+   OSM_PAGING_MADVISE_DONTNEED - madvise(MADV_DONTNEED) of anonymous memory
+                                 whose pages were all touched, per call.
+   */
+enum osm_paging_kind {
+    OSM_PAGING_MINOR_FAULT, OSM_PAGING_MAJOR_FAULT, OSM_PAGING_MMAP_MUNMAP,
+    OSM_PAGING_MADVISE_DONTNEED, OSM_PAGING_KIND_COUNT
+};
+
+
+/* Page sizes of the anonymous memory of the paging benchmarks:
+   OSM_PAGE_4K - base pages, transparent huge pages are disabled with
+                 madvise(MADV_NOHUGEPAGE).
+   OSM_PAGE_THP - transparent huge pages requested with madvise(MADV_HUGEPAGE)
+                  on memory aligned to the huge page size.
+   */
+enum osm_page_size {
+    OSM_PAGE_4K, OSM_PAGE_THP
+};
+
+
+/* returns a printable name of the paging operation,
+   and nullptr for an invalid operation.
+   */
+const char *osm_paging_name(osm_paging_kind kind);
+
+
+/* Statistical measurement of a memory management operation over a region of
+   the given size (rounded up to whole pages). The results are in
+   nano-seconds per 4 KiB page for the faults, so that both page sizes can be
+   compared directly, and per call otherwise.
+   The major faults need a file system that can drop its cached pages (not
+   tmpfs), the file is created in $TMPDIR or /var/tmp.
+   OSM_PAGE_THP is supported only by OSM_PAGING_MINOR_FAULT and
+   OSM_PAGING_MADVISE_DONTNEED, on regions of at least one huge page.
+   returns 0 upon success,
+   and -1 upon failure (e.g. transparent huge pages are disabled).
+   */
+int osm_paging_stats(osm_paging_kind kind, osm_page_size page_size, size_t bytes,
+                     const osm_config *config, osm_results *results);
+
+
+/* maximal number of threads of a contention benchmark */
+#define OSM_MAX_CONTENTION_THREADS 256
+
+
+/* Operations measured by the contention benchmarks, every thread runs the
+   operation on data shared by all the threads:
+   OSM_CONTENTION_FETCH_ADD - fetch_add on one shared 64-bit atomic.
+   OSM_CONTENTION_CAS - compare_exchange loop incrementing the shared atomic.
+   OSM_CONTENTION_EXCHANGE - exchange on the shared atomic.
+   OSM_CONTENTION_MUTEX - lock, increment and unlock of one shared mutex.
+   OSM_CONTENTION_SHARED_LINE - read and write of a private byte, all the
+                                bytes in the same cache line (false sharing).
+   OSM_CONTENTION_PADDED_LINES - the same with every byte in its own line.
+   */
+enum osm_contention_kind {
+    OSM_CONTENTION_FETCH_ADD, OSM_CONTENTION_CAS, OSM_CONTENTION_EXCHANGE,
+    OSM_CONTENTION_MUTEX, OSM_CONTENTION_SHARED_LINE, OSM_CONTENTION_PADDED_LINES,
+    OSM_CONTENTION_KIND_COUNT
+};
+
+
+/* returns a printable name of the contention operation,
+   and nullptr for an invalid operation.
+   */
+const char *osm_contention_name(osm_contention_kind kind);
+
+
+/* Statistical measurement of an operation run concurrently by threads
+   threads (1 to OSM_MAX_CONTENTION_THREADS), the calling thread being one of
+   them. Thread i is pinned to the (i modulo the number of allowed CPUs)-th
+   allowed CPU. The results are the latency of a single operation as seen
+   by every thread, and throughput (if not nullptr) is set to the aggregate
+   number of operations per second of all the threads, at the median.
+   returns 0 upon success,
+   and -1 upon failure.
+   */
+int osm_contention_stats(osm_contention_kind kind, int threads,
+                         const osm_config *config, osm_results *results,
+                         double *throughput);
+
+
+/* Instruction kernels, every operation is hidden from the optimizer by an
+   escape barrier so that it is executed as written at any optimization level:
+   OSM_KERNEL_INT_ADD, OSM_KERNEL_INT_MUL, OSM_KERNEL_INT_DIV - 64-bit integer
+                                                              add, mul and div.
+   OSM_KERNEL_FP_ADD, OSM_KERNEL_FP_MUL, OSM_KERNEL_FP_DIV - double precision.
+   OSM_KERNEL_SSE_ADD, OSM_KERNEL_SSE_MUL - packed double SSE2.
+   OSM_KERNEL_AVX2_ADD, OSM_KERNEL_AVX2_MUL - packed 32-bit integer AVX2,
+                                              on CPUs that support it.
+   */
+enum osm_kernel {
+    OSM_KERNEL_INT_ADD, OSM_KERNEL_INT_MUL, OSM_KERNEL_INT_DIV,
+    OSM_KERNEL_FP_ADD, OSM_KERNEL_FP_MUL, OSM_KERNEL_FP_DIV,
+    OSM_KERNEL_SSE_ADD, OSM_KERNEL_SSE_MUL,
+    OSM_KERNEL_AVX2_ADD, OSM_KERNEL_AVX2_MUL,
+    OSM_KERNEL_COUNT
+};
+
+
+/* Modes of the instruction kernels:
+   OSM_CHAIN_DEPENDENT - a single chain of dependent operations,
+                         measures the latency of the instruction.
+   OSM_CHAIN_INDEPENDENT - several independent chains side by side,
+                           measures the throughput of the instruction.
+   */
+enum osm_chain_mode {
+    OSM_CHAIN_DEPENDENT, OSM_CHAIN_INDEPENDENT
+};
+
+
+/* returns a printable name of the kernel,
+   and nullptr for an invalid kernel.
+   */
+const char *osm_kernel_name(osm_kernel kernel);
+
+
+/* Statistical measurement of an instruction kernel, the results are in
+   nano-seconds per instruction.
+   returns 0 upon success,
+   and -1 upon failure (e.g. the CPU does not support the instructions).
+   */
+int osm_kernel_stats(osm_kernel kernel, osm_chain_mode mode,
+                     const osm_config *config, osm_results *results);
+
+
 #endif
\ No newline at end of file
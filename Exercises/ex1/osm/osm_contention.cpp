@@ -0,0 +1,254 @@
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+#include "osm_cpu.h"
+
+#define FAIL -1
+#define ORIGINAL_MASK -1
+#define SEC_TO_NANO 1e9
+/* two lines, so that the adjacent line prefetcher does not pair them up */
+#define PADDING 128
+
+static const char *const CONTENTION_NAMES[OSM_CONTENTION_KIND_COUNT] = {
+    "fetch_add", "cas", "exchange", "mutex", "shared_line", "padded_lines"
+};
+
+/**
+ * A private byte alone in its cache lines
+ */
+struct alignas(PADDING) PaddedSlot {
+    std::atomic<uint8_t> value;
+};
+
+/**
+ * Data shared by the threads of a contention trial
+ */
+struct Contention {
+    osm_contention_kind kind;
+    unsigned int iterations;
+    bool oversubscribed;
+    alignas(PADDING) std::atomic<int> ready;
+    std::atomic<int> done;
+    std::atomic<bool> go;
+    alignas(PADDING) std::atomic<uint64_t> counter;
+    alignas(PADDING) pthread_mutex_t mutex;
+    uint64_t guarded;
+    alignas(PADDING) std::atomic<uint8_t> packed[OSM_MAX_CONTENTION_THREADS];
+    PaddedSlot padded[OSM_MAX_CONTENTION_THREADS];
+};
+
+/**
+ * Arguments of a single contention trial
+ */
+struct ContentionTrial {
+    osm_contention_kind kind;
+    int threads;
+};
+
+static Contention shared;
+
+/**
+ * Helper function that increments a private byte with a plain read and write
+ * @param slot the byte
+ * @param iterations Number of increments
+ */
+static void increment_slot (std::atomic<uint8_t> &slot, unsigned int iterations)
+{
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      slot.store ((uint8_t) (slot.load (std::memory_order_relaxed) + 1), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Runs the measured operation of the trial
+ * @param index index of the calling thread
+ */
+static void run_operation (int index)
+{
+  unsigned int iterations = shared.iterations;
+  switch (shared.kind)
+    {
+      case OSM_CONTENTION_FETCH_ADD:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            shared.counter.fetch_add (1);
+          }
+        break;
+      case OSM_CONTENTION_CAS:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            uint64_t expected = shared.counter.load (std::memory_order_relaxed);
+            while (!shared.counter.compare_exchange_weak (expected, expected + 1))
+              {}
+          }
+        break;
+      case OSM_CONTENTION_EXCHANGE:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            shared.counter.exchange (i);
+          }
+        break;
+      case OSM_CONTENTION_MUTEX:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            pthread_mutex_lock (&shared.mutex);
+            shared.guarded++;
+            pthread_mutex_unlock (&shared.mutex);
+          }
+        break;
+      case OSM_CONTENTION_SHARED_LINE:
+        increment_slot (shared.packed[index], iterations);
+        break;
+      default:
+        increment_slot (shared.padded[index].value, iterations);
+        break;
+    }
+}
+
+/**
+ * Waits until the counter reaches the target, giving the CPU away when there
+ * are more threads than CPUs
+ * @param counter the counter
+ * @param target the target value
+ */
+static void wait_for (const std::atomic<int> &counter, int target)
+{
+  while (counter.load () < target)
+    {
+      if (shared.oversubscribed)
+        {
+          sched_yield ();
+        }
+    }
+}
+
+/**
+ * Entry point of the threads other than the calling one
+ * @param arg index of the thread
+ * @return nullptr
+ */
+static void *contention_worker (void *arg)
+{
+  int index = (int) (intptr_t) arg;
+  shared.ready.fetch_add (1);
+  while (!shared.go.load ())
+    {
+      if (shared.oversubscribed)
+        {
+          sched_yield ();
+        }
+    }
+  run_operation (index);
+  shared.done.fetch_add (1);
+  return nullptr;
+}
+
+/**
+ * Helper function that finds the CPU of a thread
+ * @param index index of the thread
+ * @return the CPU in case of success, -1 otherwise.
+ */
+static int cpu_of (int index)
+{
+  int cpus = osm_cpu_count ();
+  return cpus <= 0 ? FAIL : osm_cpu_allowed (index % cpus);
+}
+
+/**
+ * Harness trial of a contention benchmark. The other threads are created
+ * and wait before the timed region, which starts when they are released
+ * and ends when the last of them is done.
+ * @param iterations Number of operations of every thread
+ * @param arg Pointer to the ContentionTrial
+ * @return The latency of a single operation in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+static double contention_trial (unsigned int iterations, void *arg)
+{
+  ContentionTrial *trial = (ContentionTrial *) arg;
+  shared.kind = trial->kind;
+  shared.iterations = iterations;
+  shared.oversubscribed = trial->threads > osm_cpu_count ();
+  shared.ready.store (0);
+  shared.done.store (0);
+  shared.go.store (false);
+  shared.counter.store (0);
+  if (cpu_of (0) == FAIL || osm_pin_thread (cpu_of (0)) == FAIL)
+    {
+      return FAIL;
+    }
+
+  pthread_t workers[OSM_MAX_CONTENTION_THREADS];
+  int created = 1;
+  for (; created < trial->threads; created++)
+    {
+      cpu_set_t mask;
+      CPU_ZERO (&mask);
+      CPU_SET (cpu_of (created), &mask);
+      pthread_attr_t attr;
+      pthread_attr_init (&attr);
+      pthread_attr_setaffinity_np (&attr, sizeof (mask), &mask);
+      int ret = pthread_create (&workers[created], &attr, &contention_worker,
+                                (void *) (intptr_t) created);
+      pthread_attr_destroy (&attr);
+      if (ret != 0)
+        {
+          break;
+        }
+    }
+  wait_for (shared.ready, created - 1);
+
+  uint64_t start = osm_region_begin ();
+  shared.go.store (true);
+  if (created == trial->threads)
+    {
+      run_operation (0);
+      wait_for (shared.done, created - 1);
+    }
+  uint64_t end = osm_region_end ();
+  for (int i = 1; i < created; i++)
+    {
+      pthread_join (workers[i], nullptr);
+    }
+  osm_pin_thread (ORIGINAL_MASK);
+  if (created != trial->threads || start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+const char *osm_contention_name (osm_contention_kind kind)
+{
+  if (kind < 0 || kind >= OSM_CONTENTION_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return CONTENTION_NAMES[kind];
+}
+
+int osm_contention_stats (osm_contention_kind kind, int threads,
+                          const osm_config *config, osm_results *results,
+                          double *throughput)
+{
+  if (kind < 0 || kind >= OSM_CONTENTION_KIND_COUNT || threads < 1
+      || threads > OSM_MAX_CONTENTION_THREADS)
+    {
+      return FAIL;
+    }
+  pthread_mutex_init (&shared.mutex, nullptr);
+  ContentionTrial trial = {kind, threads};
+  int ret = osm_measure (&contention_trial, &trial, config, results);
+  pthread_mutex_destroy (&shared.mutex);
+  if (ret == 0 && throughput != nullptr)
+    {
+      *throughput = results->median > 0 ? threads * SEC_TO_NANO / results->median : 0;
+    }
+  return ret;
+}
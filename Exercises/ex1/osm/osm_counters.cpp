@@ -0,0 +1,230 @@
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "osm_counters.h"
+#include "osm_timer.h"
+
+#define FAIL -1
+#define NOT_OPENED -1
+
+/**
+ * perf_event_open type and config of a counter
+ */
+struct CounterSpec {
+    uint32_t type;
+    uint64_t config;
+};
+
+/**
+ * Layout of a read of the counter group (PERF_FORMAT_GROUP with the
+ * enabled and running times)
+ */
+struct GroupRead {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[OSM_COUNTER_COUNT];
+};
+
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+                                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const CounterSpec COUNTER_SPECS[OSM_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS (PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS (PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+static const char *const COUNTER_NAMES[OSM_COUNTER_COUNT] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "dtlb_misses"
+};
+
+static bool counters_enabled = false;
+static int group_fd = NOT_OPENED;
+static int counter_fds[OSM_COUNTER_COUNT];
+static int counter_slots[OSM_COUNTER_COUNT];
+static GroupRead region_start;
+static bool region_started = false;
+static double accumulated[OSM_COUNTER_COUNT];
+static bool counted[OSM_COUNTER_COUNT];
+
+/**
+ * Helper function that opens a single counter of the calling thread
+ * @param counter the counter
+ * @param leader fd of the group leader, -1 to open a new group
+ * @param exclude_kernel whether to count only user space
+ * @return the fd in case of success, -1 otherwise.
+ */
+static int open_counter (int counter, int leader, bool exclude_kernel)
+{
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = COUNTER_SPECS[counter].type;
+  attr.config = COUNTER_SPECS[counter].config;
+  attr.disabled = leader == NOT_OPENED;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int) syscall (SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Helper function that closes every opened counter
+ */
+static void close_counters ()
+{
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      if (counter_fds[counter] != NOT_OPENED)
+        {
+          close (counter_fds[counter]);
+        }
+      counter_fds[counter] = NOT_OPENED;
+      counter_slots[counter] = NOT_OPENED;
+    }
+  group_fd = NOT_OPENED;
+  counters_enabled = false;
+}
+
+/**
+ * Helper function that opens all the counters the kernel accepts as a single
+ * group, counting the kernel too when allowed
+ * @return 0 if at least one counter was opened, -1 otherwise.
+ */
+static int open_counters ()
+{
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      counter_fds[counter] = NOT_OPENED;
+      counter_slots[counter] = NOT_OPENED;
+    }
+  bool exclude_kernel = false;
+  int slots = 0;
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      int fd = open_counter (counter, group_fd, exclude_kernel);
+      if (fd == FAIL && group_fd == NOT_OPENED && !exclude_kernel)
+        {
+          exclude_kernel = true;
+          fd = open_counter (counter, group_fd, exclude_kernel);
+        }
+      if (fd == FAIL)
+        {
+          continue;
+        }
+      if (group_fd == NOT_OPENED)
+        {
+          group_fd = fd;
+        }
+      counter_fds[counter] = fd;
+      counter_slots[counter] = slots++;
+    }
+  if (group_fd == NOT_OPENED
+      || ioctl (group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == FAIL)
+    {
+      close_counters ();
+      return FAIL;
+    }
+  return 0;
+}
+
+int osm_set_counters (bool enable)
+{
+  if (counters_enabled)
+    {
+      close_counters ();
+    }
+  if (!enable)
+    {
+      return 0;
+    }
+  if (open_counters () == FAIL)
+    {
+      return FAIL;
+    }
+  counters_enabled = true;
+  return 0;
+}
+
+const char *osm_counter_name (osm_counter counter)
+{
+  if (counter < 0 || counter >= OSM_COUNTER_COUNT)
+    {
+      return nullptr;
+    }
+  return COUNTER_NAMES[counter];
+}
+
+/**
+ * Helper function that reads the whole group at once
+ * @param group output
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int read_group (GroupRead *group)
+{
+  ssize_t size = read (group_fd, group, sizeof (*group));
+  return size >= (ssize_t) (3 * sizeof (uint64_t)) ? 0 : FAIL;
+}
+
+uint64_t osm_region_begin ()
+{
+  region_started = counters_enabled && read_group (&region_start) == 0;
+  return osm_timer_read ();
+}
+
+uint64_t osm_region_end ()
+{
+  uint64_t end = osm_timer_read ();
+  GroupRead region_end;
+  if (!region_started || read_group (&region_end) == FAIL)
+    {
+      return end;
+    }
+  region_started = false;
+  uint64_t running = region_end.time_running - region_start.time_running;
+  uint64_t enabled = region_end.time_enabled - region_start.time_enabled;
+  if (running == 0)
+    {
+      return end;
+    }
+  /* the group may have been multiplexed with other events */
+  double scale = (double) enabled / (double) running;
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      int slot = counter_slots[counter];
+      if (slot == NOT_OPENED || (uint64_t) slot >= region_end.nr)
+        {
+          continue;
+        }
+      accumulated[counter] += scale * (double) (region_end.values[slot] - region_start.values[slot]);
+      counted[counter] = true;
+    }
+  return end;
+}
+
+void osm_counters_reset ()
+{
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      accumulated[counter] = 0;
+      counted[counter] = false;
+    }
+  region_started = false;
+}
+
+void osm_counters_collect (double counts[OSM_COUNTER_COUNT],
+                           bool valid[OSM_COUNTER_COUNT])
+{
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      counts[counter] = accumulated[counter];
+      valid[counter] = counted[counter];
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _OSM_COUNTERS_H
+#define _OSM_COUNTERS_H
+
+#include <stdint.h>
+#include "osm.h"
+
+
+/* Starts a timed region: snapshots the enabled counters and then reads the
+   timer, so that reading the counters is not timed.
+   returns the timer reading as osm_timer_read does.
+   */
+uint64_t osm_region_begin();
+
+
+/* Ends the timed region started last: reads the timer and then adds the
+   counter deltas since osm_region_begin to the accumulated counts.
+   returns the timer reading as osm_timer_read does.
+   */
+uint64_t osm_region_end();
+
+
+/* Clears the accumulated counts. */
+void osm_counters_reset();
+
+
+/* Copies the accumulated count of every counter into counts, valid[c] is set
+   for the counters that were enabled and actually counted.
+   */
+void osm_counters_collect(double counts[OSM_COUNTER_COUNT],
+                          bool valid[OSM_COUNTER_COUNT]);
+
+
+#endif
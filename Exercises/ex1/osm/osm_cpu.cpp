@@ -0,0 +1,68 @@
+#include <sched.h>
+#include <pthread.h>
+#include "osm_cpu.h"
+
+#define FAIL -1
+
+static cpu_set_t original_mask;
+static bool mask_saved = false;
+
+/**
+ * Helper function that saves the affinity mask of the process the first
+ * time it is needed, before osm pins any thread
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int save_mask ()
+{
+  if (mask_saved)
+    {
+      return 0;
+    }
+  CPU_ZERO (&original_mask);
+  if (sched_getaffinity (0, sizeof (original_mask), &original_mask) == -1)
+    {
+      return FAIL;
+    }
+  mask_saved = true;
+  return 0;
+}
+
+int osm_cpu_count ()
+{
+  if (save_mask () == FAIL)
+    {
+      return FAIL;
+    }
+  return CPU_COUNT (&original_mask);
+}
+
+int osm_cpu_allowed (int index)
+{
+  if (index < 0 || save_mask () == FAIL)
+    {
+      return FAIL;
+    }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (CPU_ISSET (cpu, &original_mask) && index-- == 0)
+        {
+          return cpu;
+        }
+    }
+  return FAIL;
+}
+
+int osm_pin_thread (int cpu)
+{
+  if (save_mask () == FAIL || cpu >= CPU_SETSIZE)
+    {
+      return FAIL;
+    }
+  cpu_set_t mask = original_mask;
+  if (cpu >= 0)
+    {
+      CPU_ZERO (&mask);
+      CPU_SET (cpu, &mask);
+    }
+  return pthread_setaffinity_np (pthread_self (), sizeof (mask), &mask) == 0 ? 0 : FAIL;
+}
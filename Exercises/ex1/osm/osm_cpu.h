@@ -0,0 +1,24 @@
+#ifndef _OSM_CPU_H
+#define _OSM_CPU_H
+
+
+/* returns the number of CPUs the process was allowed to run on when osm
+   first looked at its affinity mask.
+   */
+int osm_cpu_count();
+
+
+/* returns the index-th CPU the process is allowed to run on,
+   and -1 if there are not that many CPUs.
+   */
+int osm_cpu_allowed(int index);
+
+
+/* Pins the calling thread to cpu, or restores the original affinity mask
+   of the process when cpu is -1.
+   returns 0 upon success, and -1 upon failure.
+   */
+int osm_pin_thread(int cpu);
+
+
+#endif
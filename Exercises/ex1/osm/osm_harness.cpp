@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+#define DEFAULT_WARMUP_TRIALS 2
+#define DEFAULT_MIN_TRIALS 10
+#define DEFAULT_MAX_TRIALS 200
+#define DEFAULT_ITERATIONS 200000
+#define DEFAULT_MIN_TRIAL_NS 1000000.0
+#define DEFAULT_TARGET_CI 0.01
+#define DEFAULT_OUTLIER_THRESHOLD 3.5
+#define MAX_ADAPTIVE_ITERATIONS (1u << 24)
+#define MAX_TRIAL_FACTOR 4
+#define MAD_TO_STDDEV 1.4826
+#define T_TABLE_SIZE 30
+#define Z_95 1.96
+
+/* two sided 95% critical values of Student's t distribution, by degrees of freedom */
+static const double T_95[T_TABLE_SIZE] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+void osm_default_config (osm_config *config)
+{
+  config->warmup_trials = DEFAULT_WARMUP_TRIALS;
+  config->min_trials = DEFAULT_MIN_TRIALS;
+  config->max_trials = DEFAULT_MAX_TRIALS;
+  config->iterations = DEFAULT_ITERATIONS;
+  config->adaptive = true;
+  config->min_trial_ns = DEFAULT_MIN_TRIAL_NS;
+  config->target_ci = DEFAULT_TARGET_CI;
+  config->outlier_threshold = DEFAULT_OUTLIER_THRESHOLD;
+}
+
+osm_config osm_slow_config (const osm_config *config)
+{
+  osm_config slow = *config;
+  if (slow.adaptive)
+    {
+      slow.iterations = 1;
+    }
+  return slow;
+}
+
+/**
+ * Helper function that finds the two sided 95% critical value of Student's t
+ * distribution
+ * @param freedom degrees of freedom (rounded down when fractional)
+ * @return the critical value, 0 without degrees of freedom
+ */
+static double t_critical (double freedom)
+{
+  if (freedom < 1)
+    {
+      return 0;
+    }
+  return freedom < T_TABLE_SIZE + 1 ? T_95[(size_t) freedom - 1] : Z_95;
+}
+
+/**
+ * Helper function that finds a percentile of sorted samples, interpolating
+ * linearly between the two closest ranks
+ * @param sorted sorted samples
+ * @param percentile percentile in [0, 100]
+ * @return the percentile value
+ */
+static double percentile_of (const std::vector<double> &sorted, double percentile)
+{
+  double rank = percentile / 100.0 * (double) (sorted.size () - 1);
+  size_t low = (size_t) rank;
+  if (low + 1 >= sorted.size ())
+    {
+      return sorted.back ();
+    }
+  double fraction = rank - (double) low;
+  return sorted[low] + fraction * (sorted[low + 1] - sorted[low]);
+}
+
+int osm_summarize (double *samples, unsigned int n, double outlier_threshold,
+                   unsigned int iterations, osm_results *results)
+{
+  if (samples == nullptr || n == 0 || results == nullptr)
+    {
+      return FAIL;
+    }
+  std::sort (samples, samples + n);
+  std::vector<double> all (samples, samples + n);
+  double median = percentile_of (all, 50);
+
+  std::vector<double> kept;
+  if (outlier_threshold > 0)
+    {
+      std::vector<double> deviations;
+      for (double sample: all)
+        {
+          deviations.push_back (std::fabs (sample - median));
+        }
+      std::sort (deviations.begin (), deviations.end ());
+      double scale = MAD_TO_STDDEV * percentile_of (deviations, 50);
+      for (double sample: all)
+        {
+          if (scale == 0 || std::fabs (sample - median) <= outlier_threshold * scale)
+            {
+              kept.push_back (sample);
+            }
+        }
+    }
+  else
+    {
+      kept = all;
+    }
+
+  double sum = 0;
+  for (double sample: kept)
+    {
+      sum += sample;
+    }
+  double mean = sum / (double) kept.size ();
+  double squares = 0;
+  for (double sample: kept)
+    {
+      squares += (sample - mean) * (sample - mean);
+    }
+  double stddev = kept.size () > 1 ? std::sqrt (squares / (double) (kept.size () - 1)) : 0;
+  double t = t_critical ((double) (kept.size () - 1));
+
+  results->iterations = iterations;
+  results->trials = (unsigned int) kept.size ();
+  results->rejected = n - (unsigned int) kept.size ();
+  results->min = kept.front ();
+  results->median = percentile_of (kept, 50);
+  results->mean = mean;
+  results->p90 = percentile_of (kept, 90);
+  results->p99 = percentile_of (kept, 99);
+  results->max = kept.back ();
+  results->stddev = stddev;
+  results->ci95 = t * stddev / std::sqrt ((double) kept.size ());
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      results->counter_valid[counter] = false;
+      results->counters[counter] = 0;
+    }
+  return 0;
+}
+
+osm_change osm_compare (const osm_results *baseline, const osm_results *current,
+                        double threshold)
+{
+  if (baseline == nullptr || current == nullptr || baseline->trials < 2
+      || current->trials < 2 || baseline->mean <= 0)
+    {
+      return OSM_UNCHANGED;
+    }
+  double base_error = baseline->stddev * baseline->stddev / baseline->trials;
+  double current_error = current->stddev * current->stddev / current->trials;
+  double difference = current->mean - baseline->mean;
+  if (std::fabs (difference) <= threshold * baseline->mean)
+    {
+      return OSM_UNCHANGED;
+    }
+  double error = base_error + current_error;
+  if (error > 0)
+    {
+      /* Welch-Satterthwaite degrees of freedom */
+      double freedom = error * error
+                       / (base_error * base_error / (baseline->trials - 1)
+                          + current_error * current_error / (current->trials - 1));
+      if (std::fabs (difference) / std::sqrt (error) <= t_critical (freedom))
+        {
+          return OSM_UNCHANGED;
+        }
+    }
+  return difference > 0 ? OSM_REGRESSED : OSM_IMPROVED;
+}
+
+void osm_scale_results (osm_results *results, double factor)
+{
+  results->min *= factor;
+  results->median *= factor;
+  results->mean *= factor;
+  results->p90 *= factor;
+  results->p99 *= factor;
+  results->max *= factor;
+  results->stddev *= factor;
+  results->ci95 *= factor;
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      results->counters[counter] *= factor;
+    }
+}
+
+/**
+ * Helper function that checks whether the confidence interval of the
+ * samples collected so far is tight enough
+ * @param samples the samples so far
+ * @param config harness configuration
+ * @return true if no more trials are needed, false otherwise.
+ */
+static bool converged (const std::vector<double> &samples, const osm_config *config)
+{
+  std::vector<double> copy (samples);
+  osm_results partial{};
+  if (osm_summarize (copy.data (), (unsigned int) copy.size (), config->outlier_threshold,
+                     0, &partial) == FAIL)
+    {
+      return false;
+    }
+  return partial.ci95 <= config->target_ci * partial.mean;
+}
+
+/**
+ * Helper function that adds the counts of the last trial to the totals
+ * @param totals the counts of the trials so far
+ * @param counted whether each counter counted in any of the trials so far
+ */
+static void accumulate_counters (double totals[OSM_COUNTER_COUNT],
+                                 bool counted[OSM_COUNTER_COUNT])
+{
+  double counts[OSM_COUNTER_COUNT];
+  bool valid[OSM_COUNTER_COUNT];
+  osm_counters_collect (counts, valid);
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      if (valid[counter])
+        {
+          totals[counter] += counts[counter];
+          counted[counter] = true;
+        }
+    }
+}
+
+int osm_measure (osm_trial trial, void *arg, const osm_config *config,
+                 osm_results *results)
+{
+  if (trial == nullptr || config == nullptr || results == nullptr
+      || config->iterations == 0 || config->min_trials == 0
+      || config->max_trials < config->min_trials)
+    {
+      return FAIL;
+    }
+  unsigned int iterations = config->iterations;
+  if (config->adaptive)
+    {
+      double per_op = trial (iterations, arg);
+      while (per_op != FAIL && per_op * iterations < config->min_trial_ns
+             && iterations < MAX_ADAPTIVE_ITERATIONS)
+        {
+          iterations *= 2;
+          per_op = trial (iterations, arg);
+        }
+      while (per_op != FAIL && per_op * iterations > MAX_TRIAL_FACTOR * config->min_trial_ns
+             && iterations > 1)
+        {
+          iterations /= 2;
+          per_op = trial (iterations, arg);
+        }
+      if (per_op == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  for (unsigned int i = 0; i < config->warmup_trials; i++)
+    {
+      if (trial (iterations, arg) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+
+  std::vector<double> samples;
+  double totals[OSM_COUNTER_COUNT] = {0};
+  bool counted[OSM_COUNTER_COUNT] = {false};
+  while (samples.size () < config->max_trials)
+    {
+      osm_counters_reset ();
+      double per_op = trial (iterations, arg);
+      if (per_op == FAIL)
+        {
+          return FAIL;
+        }
+      samples.push_back (per_op);
+      accumulate_counters (totals, counted);
+      if (samples.size () >= config->min_trials
+          && (!config->adaptive || converged (samples, config)))
+        {
+          break;
+        }
+    }
+  if (osm_summarize (samples.data (), (unsigned int) samples.size (),
+                     config->outlier_threshold, iterations, results) == FAIL)
+    {
+      return FAIL;
+    }
+  double operations = (double) iterations * (double) samples.size ();
+  for (int counter = 0; counter < OSM_COUNTER_COUNT; counter++)
+    {
+      results->counter_valid[counter] = counted[counter];
+      results->counters[counter] = counted[counter] ? totals[counter] / operations : 0;
+    }
+  return 0;
+}
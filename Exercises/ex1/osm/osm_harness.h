@@ -0,0 +1,47 @@
+#ifndef _OSM_HARNESS_H
+#define _OSM_HARNESS_H
+
+#include "osm.h"
+
+
+/* A single timed trial of a benchmark.
+   runs the measured operation iterations times (arg is benchmark specific)
+   and returns the time per iteration in nano-seconds upon success,
+   and -1 upon failure. The counters are divided by the iterations as well,
+   so a benchmark whose iteration holds several units of work scales the
+   results with osm_scale_results instead of dividing in the trial.
+   */
+typedef double (*osm_trial)(unsigned int iterations, void *arg);
+
+
+/* Runs trial according to config (warmup, repeated trials, adaptive
+   iteration count) and fills results with the statistics of the kept trials.
+   returns 0 upon success, and -1 upon failure.
+   */
+int osm_measure(osm_trial trial, void *arg, const osm_config *config,
+                osm_results *results);
+
+
+/* returns a copy of config for operations that take micro-seconds or more:
+   when adaptive, the search starts from a single iteration instead of
+   config->iterations, so that the first trial does not take minutes.
+   */
+osm_config osm_slow_config(const osm_config *config);
+
+
+/* Computes the statistics of n samples (sorted in place), rejecting samples
+   that are more than outlier_threshold scaled MADs away from the median
+   (0 disables the rejection). iterations is copied to the results as is.
+   returns 0 upon success, and -1 upon failure (e.g. no samples).
+   */
+int osm_summarize(double *samples, unsigned int n, double outlier_threshold,
+                  unsigned int iterations, osm_results *results);
+
+
+/* Multiplies every time and counter of results by factor, e.g. to turn the
+   figures of a trial iteration into those of a smaller unit of work.
+   */
+void osm_scale_results(osm_results *results, double factor);
+
+
+#endif
@@ -0,0 +1,675 @@
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+#include "osm_cpu.h"
+
+#define FAIL -1
+#define CACHE_LINE 64
+/* twice the largest message, so a message never waits for its own end */
+#define RING_BYTES ((size_t) 2 * OSM_MAX_IPC_MESSAGE)
+#define MAX_QUEUED_CONNECTIONS 1
+/* room for the bookkeeping of the kernel around a datagram */
+#define DGRAM_SLACK 4096
+#define ACK_BYTES 1
+#define DIRECTIONS_PER_ROUND_TRIP 2
+#define SEC_TO_NANO 1e9
+
+static const char *const IPC_NAMES[OSM_IPC_TRANSPORT_COUNT] = {
+    "pipe", "unix_stream", "unix_dgram", "tcp", "eventfd", "shm_ring"
+};
+
+/**
+ * Single-producer single-consumer ring of bytes in shared memory. head and
+ * tail count the bytes written and read so far, a side that has to wait
+ * for the other one sets its waiting flag and sleeps on its eventfd (or
+ * spins, for OSM_IPC_SHM_RING).
+ */
+struct Ring {
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;
+    std::atomic<int> reader_waiting;
+    int data_event;
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+    std::atomic<int> writer_waiting;
+    int space_event;
+    alignas(CACHE_LINE) char data[RING_BYTES];
+};
+
+/**
+ * The rings of both directions, mapped before the fork
+ */
+struct SharedRings {
+    Ring to_child;
+    Ring to_parent;
+};
+
+/**
+ * One side of a transport, either a pair of fds or a pair of rings
+ */
+struct Endpoint {
+    int send_fd;
+    int recv_fd;
+    Ring *send_ring;
+    Ring *recv_ring;
+};
+
+/**
+ * Arguments of an IPC trial
+ */
+struct IpcTrial {
+    osm_ipc_transport transport;
+    osm_ipc_mode mode;
+    size_t bytes;
+    SharedRings *rings;
+    bool oversubscribed;
+};
+
+/* -------------------------------- sockets --------------------------------- */
+
+/**
+ * Helper function for establishing a server on the loopback, the way ex5
+ * does, on a port chosen by the kernel
+ * @param port output, the port of the server
+ * @return the listening socket in case of success, -1 otherwise.
+ */
+static int establish (unsigned short *port)
+{
+  struct sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  sa.sin_port = 0;
+  int s = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (s < 0)
+    {
+      return FAIL;
+    }
+  socklen_t length = sizeof (sa);
+  if (bind (s, (struct sockaddr *) &sa, sizeof (sa)) < 0
+      || getsockname (s, (struct sockaddr *) &sa, &length) < 0
+      || listen (s, MAX_QUEUED_CONNECTIONS) < 0)
+    {
+      close (s);
+      return FAIL;
+    }
+  *port = ntohs (sa.sin_port);
+  return s;
+}
+
+/**
+ * Helper function that connects a client to the server of establish
+ * @param port port of the server
+ * @return the socket in case of success, -1 otherwise.
+ */
+static int call_socket (unsigned short port)
+{
+  struct sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  sa.sin_port = htons (port);
+  int s = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (s < 0)
+    {
+      return FAIL;
+    }
+  if (connect (s, (struct sockaddr *) &sa, sizeof (sa)) < 0)
+    {
+      close (s);
+      return FAIL;
+    }
+  return s;
+}
+
+/**
+ * Helper function that disables Nagle's algorithm, so that the last segment
+ * of a message is not held back
+ * @param s socket
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int no_delay (int s)
+{
+  int on = 1;
+  return setsockopt (s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+}
+
+/**
+ * Helper function that lets a datagram socket send messages of the given
+ * size, forcing the limit of the system when running as root
+ * @param s socket
+ * @param bytes size of the messages
+ */
+static void fit_datagrams (int s, size_t bytes)
+{
+  int size = (int) (bytes + DGRAM_SLACK);
+  if (setsockopt (s, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof (size)) == FAIL)
+    {
+      setsockopt (s, SOL_SOCKET, SO_SNDBUF, &size, sizeof (size));
+    }
+}
+
+/* --------------------------------- rings ---------------------------------- */
+
+/**
+ * Helper function that gives the CPU away while spinning, when the peer
+ * may need it
+ * @param trial the trial
+ */
+static void relax (const IpcTrial *trial)
+{
+  if (trial->oversubscribed)
+    {
+      sched_yield ();
+    }
+}
+
+/**
+ * Waits until a counter of a ring moves from the given value
+ * @param trial the trial, spins for OSM_IPC_SHM_RING
+ * @param counter the counter
+ * @param seen the value seen
+ * @param waiting flag of the waiting side
+ * @param event eventfd of the waiting side
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int await (const IpcTrial *trial, std::atomic<uint64_t> *counter, uint64_t seen,
+                  std::atomic<int> *waiting, int event)
+{
+  if (trial->transport == OSM_IPC_SHM_RING)
+    {
+      while (counter->load (std::memory_order_acquire) == seen)
+        {
+          relax (trial);
+        }
+      return 0;
+    }
+  /* pairs with the fence of wake, either the other side sees the flag or
+     this side sees the new value */
+  waiting->store (1);
+  while (counter->load () == seen)
+    {
+      uint64_t count;
+      if (read (event, &count, sizeof (count)) != sizeof (count))
+        {
+          waiting->store (0);
+          return FAIL;
+        }
+    }
+  waiting->store (0, std::memory_order_relaxed);
+  return 0;
+}
+
+/**
+ * Wakes the other side of a ring up if it sleeps
+ * @param trial the trial
+ * @param waiting flag of the other side
+ * @param event eventfd of the other side
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int wake (const IpcTrial *trial, std::atomic<int> *waiting, int event)
+{
+  if (trial->transport == OSM_IPC_SHM_RING)
+    {
+      return 0;
+    }
+  std::atomic_thread_fence (std::memory_order_seq_cst);
+  if (waiting->load () == 0)
+    {
+      return 0;
+    }
+  uint64_t one = 1;
+  return write (event, &one, sizeof (one)) == sizeof (one) ? 0 : FAIL;
+}
+
+/**
+ * Helper function that writes a message to a ring, as much as fits at a
+ * time
+ * @param trial the trial
+ * @param ring the ring
+ * @param buf the message
+ * @param bytes size of the message
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int ring_send (const IpcTrial *trial, Ring *ring, const char *buf, size_t bytes)
+{
+  uint64_t head = ring->head.load (std::memory_order_relaxed);
+  size_t done = 0;
+  while (done < bytes)
+    {
+      uint64_t tail = ring->tail.load (std::memory_order_acquire);
+      size_t space = RING_BYTES - (size_t) (head - tail);
+      if (space == 0)
+        {
+          if (await (trial, &ring->tail, tail, &ring->writer_waiting, ring->space_event) == FAIL)
+            {
+              return FAIL;
+            }
+          continue;
+        }
+      size_t chunk = bytes - done < space ? bytes - done : space;
+      size_t offset = (size_t) head & (RING_BYTES - 1);
+      size_t first = chunk < RING_BYTES - offset ? chunk : RING_BYTES - offset;
+      memcpy (ring->data + offset, buf + done, first);
+      memcpy (ring->data, buf + done + first, chunk - first);
+      head += chunk;
+      done += chunk;
+      ring->head.store (head, std::memory_order_release);
+      if (wake (trial, &ring->reader_waiting, ring->data_event) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Helper function that reads a message from a ring, as much as arrived at
+ * a time
+ * @param trial the trial
+ * @param ring the ring
+ * @param buf output, the message
+ * @param bytes size of the message
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int ring_receive (const IpcTrial *trial, Ring *ring, char *buf, size_t bytes)
+{
+  uint64_t tail = ring->tail.load (std::memory_order_relaxed);
+  size_t done = 0;
+  while (done < bytes)
+    {
+      uint64_t head = ring->head.load (std::memory_order_acquire);
+      size_t available = (size_t) (head - tail);
+      if (available == 0)
+        {
+          if (await (trial, &ring->head, head, &ring->reader_waiting, ring->data_event) == FAIL)
+            {
+              return FAIL;
+            }
+          continue;
+        }
+      size_t chunk = bytes - done < available ? bytes - done : available;
+      size_t offset = (size_t) tail & (RING_BYTES - 1);
+      size_t first = chunk < RING_BYTES - offset ? chunk : RING_BYTES - offset;
+      memcpy (buf + done, ring->data + offset, first);
+      memcpy (buf + done + first, ring->data, chunk - first);
+      tail += chunk;
+      done += chunk;
+      ring->tail.store (tail, std::memory_order_release);
+      if (wake (trial, &ring->writer_waiting, ring->space_event) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Helper function that empties a ring and creates its eventfds
+ * @param ring the ring
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int reset_ring (Ring *ring)
+{
+  ring->head.store (0);
+  ring->tail.store (0);
+  ring->reader_waiting.store (0);
+  ring->writer_waiting.store (0);
+  ring->data_event = eventfd (0, EFD_CLOEXEC);
+  ring->space_event = eventfd (0, EFD_CLOEXEC);
+  return ring->data_event == FAIL || ring->space_event == FAIL ? FAIL : 0;
+}
+
+/**
+ * Helper function that closes the eventfds of a ring
+ * @param ring the ring
+ */
+static void release_ring (Ring *ring)
+{
+  if (ring->data_event != FAIL)
+    {
+      close (ring->data_event);
+    }
+  if (ring->space_event != FAIL)
+    {
+      close (ring->space_event);
+    }
+}
+
+/* ------------------------------- transports ------------------------------- */
+
+/**
+ * Helper function that sends a whole message
+ * @param trial the trial
+ * @param side the sending side
+ * @param buf the message
+ * @param bytes size of the message
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int send_message (const IpcTrial *trial, const Endpoint *side, const char *buf, size_t bytes)
+{
+  if (side->send_ring != nullptr)
+    {
+      return ring_send (trial, side->send_ring, buf, bytes);
+    }
+  if (trial->transport == OSM_IPC_UNIX_DGRAM)
+    {
+      return write (side->send_fd, buf, bytes) == (ssize_t) bytes ? 0 : FAIL;
+    }
+  for (size_t done = 0; done < bytes;)
+    {
+      ssize_t ret = write (side->send_fd, buf + done, bytes - done);
+      if (ret <= 0)
+        {
+          return FAIL;
+        }
+      done += (size_t) ret;
+    }
+  return 0;
+}
+
+/**
+ * Helper function that receives a whole message
+ * @param trial the trial
+ * @param side the receiving side
+ * @param buf output, the message
+ * @param bytes size of the message
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int receive_message (const IpcTrial *trial, const Endpoint *side, char *buf, size_t bytes)
+{
+  if (side->recv_ring != nullptr)
+    {
+      return ring_receive (trial, side->recv_ring, buf, bytes);
+    }
+  if (trial->transport == OSM_IPC_UNIX_DGRAM)
+    {
+      return read (side->recv_fd, buf, bytes) == (ssize_t) bytes ? 0 : FAIL;
+    }
+  for (size_t done = 0; done < bytes;)
+    {
+      ssize_t ret = read (side->recv_fd, buf + done, bytes - done);
+      if (ret <= 0)
+        {
+          return FAIL;
+        }
+      done += (size_t) ret;
+    }
+  return 0;
+}
+
+/**
+ * Helper function that closes the fds of a side
+ * @param side the side
+ */
+static void close_endpoint (const Endpoint *side)
+{
+  if (side->send_fd != FAIL)
+    {
+      close (side->send_fd);
+    }
+  if (side->recv_fd != FAIL && side->recv_fd != side->send_fd)
+    {
+      close (side->recv_fd);
+    }
+}
+
+/**
+ * Helper function that connects the two sides of a transport
+ * @param trial the trial
+ * @param parent output, the side of the calling process
+ * @param child output, the side of the peer
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int connect_sides (const IpcTrial *trial, Endpoint *parent, Endpoint *child)
+{
+  *parent = {FAIL, FAIL, nullptr, nullptr};
+  *child = {FAIL, FAIL, nullptr, nullptr};
+  int fds[2];
+  switch (trial->transport)
+    {
+      case OSM_IPC_PIPE:
+        if (pipe2 (fds, O_CLOEXEC) == FAIL)
+          {
+            return FAIL;
+          }
+        parent->send_fd = fds[1];
+        child->recv_fd = fds[0];
+        if (pipe2 (fds, O_CLOEXEC) == FAIL)
+          {
+            close_endpoint (parent);
+            close_endpoint (child);
+            return FAIL;
+          }
+        child->send_fd = fds[1];
+        parent->recv_fd = fds[0];
+        return 0;
+      case OSM_IPC_UNIX_STREAM:
+      case OSM_IPC_UNIX_DGRAM:
+        {
+          int type = trial->transport == OSM_IPC_UNIX_STREAM ? SOCK_STREAM : SOCK_DGRAM;
+          if (socketpair (AF_UNIX, type | SOCK_CLOEXEC, 0, fds) == FAIL)
+            {
+              return FAIL;
+            }
+          if (trial->transport == OSM_IPC_UNIX_DGRAM)
+            {
+              fit_datagrams (fds[0], trial->bytes);
+              fit_datagrams (fds[1], trial->bytes);
+            }
+          parent->send_fd = parent->recv_fd = fds[0];
+          child->send_fd = child->recv_fd = fds[1];
+          return 0;
+        }
+      case OSM_IPC_TCP:
+        {
+          /* the connection is queued by the listening socket until accepted,
+             so both ends are set up before the fork */
+          unsigned short port;
+          int listener = establish (&port);
+          if (listener == FAIL)
+            {
+              return FAIL;
+            }
+          int client = call_socket (port);
+          int server = client == FAIL ? FAIL : accept4 (listener, nullptr, nullptr, SOCK_CLOEXEC);
+          close (listener);
+          if (server == FAIL || no_delay (server) == FAIL || no_delay (client) == FAIL)
+            {
+              if (client != FAIL)
+                {
+                  close (client);
+                }
+              if (server != FAIL)
+                {
+                  close (server);
+                }
+              return FAIL;
+            }
+          parent->send_fd = parent->recv_fd = server;
+          child->send_fd = child->recv_fd = client;
+          return 0;
+        }
+      default:
+        {
+          Ring *to_child = &trial->rings->to_child;
+          Ring *to_parent = &trial->rings->to_parent;
+          if (reset_ring (to_child) == FAIL || reset_ring (to_parent) == FAIL)
+            {
+              release_ring (to_child);
+              release_ring (to_parent);
+              return FAIL;
+            }
+          *parent = {FAIL, FAIL, to_child, to_parent};
+          *child = {FAIL, FAIL, to_parent, to_child};
+          return 0;
+        }
+    }
+}
+
+/* --------------------------------- trial ---------------------------------- */
+
+/**
+ * Peer side of a trial, echoes the messages of a round trip, or acknowledges
+ * the last message of a stream
+ * @param trial the trial
+ * @param side side of the peer
+ * @param iterations Number of messages after the first round trip
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int serve (const IpcTrial *trial, const Endpoint *side, unsigned int iterations)
+{
+  std::vector<char> message (trial->bytes);
+  bool echo = trial->mode == OSM_IPC_ROUND_TRIP;
+  for (unsigned int i = 0; i <= iterations; i++)
+    {
+      if (receive_message (trial, side, message.data (), trial->bytes) == FAIL)
+        {
+          return FAIL;
+        }
+      if ((i == 0 || echo) && send_message (trial, side, message.data (), trial->bytes) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  return echo ? 0 : send_message (trial, side, message.data (), ACK_BYTES);
+}
+
+/**
+ * Helper function that times the messages of a trial. The first round trip
+ * is not timed so that the start of the peer and the first touch of its
+ * buffer are left out.
+ * @param trial the trial
+ * @param side side of the calling process
+ * @param iterations Number of round trips or streamed messages
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double timed_messages (const IpcTrial *trial, const Endpoint *side, unsigned int iterations)
+{
+  std::vector<char> message (trial->bytes, 1);
+  std::vector<char> reply (trial->bytes);
+  if (send_message (trial, side, message.data (), trial->bytes) == FAIL
+      || receive_message (trial, side, reply.data (), trial->bytes) == FAIL)
+    {
+      return FAIL;
+    }
+  bool echo = trial->mode == OSM_IPC_ROUND_TRIP;
+  bool ok = true;
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; ok && i < iterations; i++)
+    {
+      ok = send_message (trial, side, message.data (), trial->bytes) == 0
+           && (!echo || receive_message (trial, side, reply.data (), trial->bytes) == 0);
+    }
+  ok = ok && (echo || receive_message (trial, side, reply.data (), ACK_BYTES) == 0);
+  uint64_t end = osm_region_end ();
+  if (!ok || start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/**
+ * Harness trial of a transport, a peer process is forked for every trial
+ * @param iterations Number of round trips or streamed messages
+ * @param arg Pointer to the IpcTrial
+ * @return The time of a single round trip or message in Nano-seconds in
+ * case of success, -1 otherwise.
+ */
+static double ipc_trial (unsigned int iterations, void *arg)
+{
+  IpcTrial *trial = (IpcTrial *) arg;
+  Endpoint parent, child;
+  if (connect_sides (trial, &parent, &child) == FAIL)
+    {
+      return FAIL;
+    }
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      close_endpoint (&parent);
+      _exit (serve (trial, &child, iterations) == 0 ? 0 : 1);
+    }
+  close_endpoint (&child);
+  double elapsed = pid == FAIL ? FAIL : timed_messages (trial, &parent, iterations);
+  /* a peer stuck on a failed trial sees the end of file and exits */
+  close_endpoint (&parent);
+  if (trial->rings != nullptr)
+    {
+      if (elapsed == FAIL && pid != FAIL)
+        {
+          kill (pid, SIGKILL);
+        }
+      release_ring (&trial->rings->to_child);
+      release_ring (&trial->rings->to_parent);
+    }
+  int status = 0;
+  if (pid != FAIL && (waitpid (pid, &status, 0) != pid || !WIFEXITED (status)
+                      || WEXITSTATUS (status) != 0))
+    {
+      elapsed = FAIL;
+    }
+  if (elapsed == FAIL)
+    {
+      return FAIL;
+    }
+  return elapsed / iterations;
+}
+
+const char *osm_ipc_name (osm_ipc_transport transport)
+{
+  if (transport < 0 || transport >= OSM_IPC_TRANSPORT_COUNT)
+    {
+      return nullptr;
+    }
+  return IPC_NAMES[transport];
+}
+
+int osm_ipc_stats (osm_ipc_transport transport, osm_ipc_mode mode, size_t message_bytes,
+                   const osm_config *config, osm_results *results, double *throughput)
+{
+  if (transport < 0 || transport >= OSM_IPC_TRANSPORT_COUNT
+      || (mode != OSM_IPC_ROUND_TRIP && mode != OSM_IPC_STREAM)
+      || message_bytes == 0 || message_bytes > OSM_MAX_IPC_MESSAGE)
+    {
+      return FAIL;
+    }
+  IpcTrial trial = {transport, mode, message_bytes, nullptr, osm_cpu_count () < 2};
+  bool ringed = transport == OSM_IPC_EVENTFD || transport == OSM_IPC_SHM_RING;
+  if (ringed)
+    {
+      void *memory = mmap (nullptr, sizeof (SharedRings), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED)
+        {
+          return FAIL;
+        }
+      trial.rings = new (memory) SharedRings;
+    }
+  /* every trial forks a peer */
+  osm_config ipc_config = osm_slow_config (config);
+  int ret = osm_measure (&ipc_trial, &trial, &ipc_config, results);
+  if (ringed)
+    {
+      munmap (trial.rings, sizeof (SharedRings));
+    }
+  if (ret == 0 && throughput != nullptr)
+    {
+      double bytes = (double) message_bytes * (mode == OSM_IPC_ROUND_TRIP ? DIRECTIONS_PER_ROUND_TRIP : 1);
+      *throughput = results->median > 0 ? bytes * SEC_TO_NANO / results->median : 0;
+    }
+  return ret;
+}
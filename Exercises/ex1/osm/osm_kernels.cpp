@@ -0,0 +1,134 @@
+#include "osm_kernels.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+
+static const char *const KERNEL_NAMES[OSM_KERNEL_COUNT] = {
+    "int_add", "int_mul", "int_div", "fp_add", "fp_mul", "fp_div",
+    "sse_add", "sse_mul", "avx2_add", "avx2_mul"
+};
+
+/**
+ * Arguments of a single kernel trial
+ */
+struct KernelTrial {
+    osm_kernel kernel;
+    osm_chain_mode mode;
+};
+
+/**
+ * Helper function that times rounds of a kernel in the given mode
+ * @param mode dependent or independent chains
+ * @param rounds Number of rounds of OSM_KERNEL_UNROLL operations
+ * @param value start of the chains
+ * @param operand the second operand of every operation
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+template <typename T, typename Op>
+static double time_chain (osm_chain_mode mode, unsigned int rounds, T value, T operand)
+{
+  uint64_t start = osm_region_begin ();
+  if (mode == OSM_CHAIN_DEPENDENT)
+    {
+      value = osm_dependent_chain<T, Op, OSM_KERNEL_UNROLL> (rounds, value, operand);
+    }
+  else
+    {
+      value = osm_independent_chains<T, Op, OSM_KERNEL_UNROLL> (rounds, value, operand);
+    }
+  uint64_t end = osm_region_end ();
+  osm_escape (value);
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/**
+ * Helper function that runs a kernel
+ * @param kernel the kernel
+ * @param mode dependent or independent chains
+ * @param rounds Number of rounds of OSM_KERNEL_UNROLL operations
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double run_kernel (osm_kernel kernel, osm_chain_mode mode, unsigned int rounds)
+{
+  switch (kernel)
+    {
+      case OSM_KERNEL_INT_ADD:
+        return time_chain<int64_t, OsmAdd> (mode, rounds, 0, 1);
+      case OSM_KERNEL_INT_MUL:
+        return time_chain<int64_t, OsmMul> (mode, rounds, 1, 1);
+      case OSM_KERNEL_INT_DIV:
+        /* a full width dividend, the slowest case of most dividers */
+        return time_chain<int64_t, OsmDiv> (mode, rounds, INT64_MAX, 1);
+      case OSM_KERNEL_FP_ADD:
+        return time_chain<double, OsmAdd> (mode, rounds, 0.0, 1.0);
+      case OSM_KERNEL_FP_MUL:
+        return time_chain<double, OsmMul> (mode, rounds, 1.0, 1.0);
+      case OSM_KERNEL_FP_DIV:
+        return time_chain<double, OsmDiv> (mode, rounds, 1.0, 1.0);
+#if defined(__x86_64__)
+      case OSM_KERNEL_SSE_ADD:
+        return time_chain<__m128d, OsmAdd> (mode, rounds, _mm_set1_pd (0.0), _mm_set1_pd (1.0));
+      case OSM_KERNEL_SSE_MUL:
+        return time_chain<__m128d, OsmMul> (mode, rounds, _mm_set1_pd (1.0), _mm_set1_pd (1.0));
+      case OSM_KERNEL_AVX2_ADD:
+      case OSM_KERNEL_AVX2_MUL:
+        if (!__builtin_cpu_supports ("avx2"))
+          {
+            return FAIL;
+          }
+        return osm_avx2_kernel (kernel, mode, rounds);
+#endif
+      default:
+        return FAIL;
+    }
+}
+
+/**
+ * Harness trial of an instruction kernel
+ * @param iterations Number of operations, rounded up to whole rounds
+ * @param arg Pointer to the KernelTrial
+ * @return The time of a single operation in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double kernel_trial (unsigned int iterations, void *arg)
+{
+  KernelTrial *trial = (KernelTrial *) arg;
+  unsigned int rounds = (iterations + OSM_KERNEL_UNROLL - 1) / OSM_KERNEL_UNROLL;
+  double elapsed = run_kernel (trial->kernel, trial->mode, rounds);
+  if (elapsed == FAIL)
+    {
+      return FAIL;
+    }
+  return elapsed / ((double) rounds * OSM_KERNEL_UNROLL);
+}
+
+const char *osm_kernel_name (osm_kernel kernel)
+{
+  if (kernel < 0 || kernel >= OSM_KERNEL_COUNT)
+    {
+      return nullptr;
+    }
+  return KERNEL_NAMES[kernel];
+}
+
+int osm_kernel_stats (osm_kernel kernel, osm_chain_mode mode,
+                      const osm_config *config, osm_results *results)
+{
+  if (kernel < 0 || kernel >= OSM_KERNEL_COUNT
+      || (mode != OSM_CHAIN_DEPENDENT && mode != OSM_CHAIN_INDEPENDENT))
+    {
+      return FAIL;
+    }
+  KernelTrial trial = {kernel, mode};
+  if (run_kernel (kernel, mode, 1) == FAIL)
+    {
+      return FAIL;
+    }
+  return osm_measure (&kernel_trial, &trial, config, results);
+}
@@ -0,0 +1,167 @@
+#ifndef _OSM_KERNELS_H
+#define _OSM_KERNELS_H
+
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "osm.h"
+
+#define OSM_INLINE inline __attribute__((always_inline))
+#define OSM_LAMBDA_INLINE __attribute__((always_inline))
+
+/* operations per round of the kernels, and independent chains in the
+   throughput mode */
+#define OSM_KERNEL_UNROLL 8
+
+
+/* Escape barrier: the compiler has to materialize value in a register and
+   then assume it was read and changed by the (empty) assembly, so it can
+   neither fold a chain of operations on value nor drop it.
+   */
+template <typename T>
+static OSM_INLINE void osm_escape(T &value)
+{
+  asm volatile("" : "+r" (value));
+}
+
+#if defined(__x86_64__)
+static OSM_INLINE void osm_escape(double &value)
+{
+  asm volatile("" : "+x" (value));
+}
+
+static OSM_INLINE void osm_escape(__m128d &value)
+{
+  asm volatile("" : "+x" (value));
+}
+
+/* only used by code compiled for AVX2 */
+static OSM_INLINE void osm_escape(__m256i &value)
+{
+  asm volatile("" : "+x" (value));
+}
+#else
+static OSM_INLINE void osm_escape(double &value)
+{
+  asm volatile("" : "+g" (value));
+}
+#endif
+
+
+/* Clobber barrier: the compiler has to assume that all of memory was read
+   and written, so pending stores are done and loads are not hoisted.
+   */
+static OSM_INLINE void osm_clobber()
+{
+  asm volatile("" : : : "memory");
+}
+
+
+/* Repeats body(0) ... body(N - 1) as straight line code, whatever the
+   optimization level decides about unrolling loops.
+   */
+template <unsigned int N>
+struct OsmUnroll {
+    template <typename Body>
+    static OSM_INLINE void run(Body &body)
+    {
+      OsmUnroll<N - 1>::run (body);
+      body (N - 1);
+    }
+};
+
+template <>
+struct OsmUnroll<0> {
+    template <typename Body>
+    static OSM_INLINE void run(Body &)
+    {}
+};
+
+
+/* The binary operations of the kernels */
+struct OsmAdd {
+    template <typename T>
+    OSM_INLINE T operator()(T a, T b) const
+    {
+      return a + b;
+    }
+};
+
+struct OsmMul {
+    template <typename T>
+    OSM_INLINE T operator()(T a, T b) const
+    {
+      return a * b;
+    }
+};
+
+struct OsmDiv {
+    template <typename T>
+    OSM_INLINE T operator()(T a, T b) const
+    {
+      return a / b;
+    }
+};
+
+
+/* Dependent chain: every operation needs the result of the previous one,
+   so rounds * UNROLL operations take rounds * UNROLL times their latency.
+   returns the end of the chain.
+   */
+template <typename T, typename Op, unsigned int UNROLL>
+static OSM_INLINE T osm_dependent_chain(unsigned int rounds, T value, T operand)
+{
+  Op op;
+  osm_escape (operand);
+  auto step = [&] (unsigned int) OSM_LAMBDA_INLINE
+  {
+    value = op (value, operand);
+    osm_escape (value);
+  };
+  for (unsigned int i = 0; i < rounds; i++)
+    {
+      OsmUnroll<UNROLL>::run (step);
+    }
+  return value;
+}
+
+
+/* Independent chains: UNROLL accumulators advance side by side, so the
+   rounds * UNROLL operations are limited by the throughput of the execution
+   units rather than by their latency.
+   returns the end of the first chain.
+   */
+template <typename T, typename Op, unsigned int UNROLL>
+static OSM_INLINE T osm_independent_chains(unsigned int rounds, T value, T operand)
+{
+  Op op;
+  osm_escape (operand);
+  T chains[UNROLL];
+  auto init = [&] (unsigned int chain) OSM_LAMBDA_INLINE
+  {
+    chains[chain] = value;
+  };
+  OsmUnroll<UNROLL>::run (init);
+  auto step = [&] (unsigned int chain) OSM_LAMBDA_INLINE
+  {
+    chains[chain] = op (chains[chain], operand);
+    osm_escape (chains[chain]);
+  };
+  for (unsigned int i = 0; i < rounds; i++)
+    {
+      OsmUnroll<UNROLL>::run (step);
+    }
+  return chains[0];
+}
+
+
+/* Runs the AVX2 kernel (OSM_KERNEL_AVX2_ADD or OSM_KERNEL_AVX2_MUL) for
+   rounds rounds of OSM_KERNEL_UNROLL operations, only on a CPU with AVX2.
+   returns the elapsed time in nano-seconds upon success,
+   and -1 upon failure.
+   */
+double osm_avx2_kernel(osm_kernel kernel, osm_chain_mode mode, unsigned int rounds);
+
+
+#endif
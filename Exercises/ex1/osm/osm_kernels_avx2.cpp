@@ -0,0 +1,80 @@
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+/* everything below is compiled for AVX2, and runs only after checking that
+   the CPU supports it */
+#pragma GCC target("avx2")
+#endif
+#include "osm_kernels.h"
+#include "osm_timer.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+
+#if defined(__x86_64__)
+
+/* The packed 32-bit integer operations */
+struct Avx2Add {
+    OSM_INLINE __m256i operator() (__m256i a, __m256i b) const
+    {
+      return _mm256_add_epi32 (a, b);
+    }
+};
+
+struct Avx2Mul {
+    OSM_INLINE __m256i operator() (__m256i a, __m256i b) const
+    {
+      return _mm256_mullo_epi32 (a, b);
+    }
+};
+
+/**
+ * Helper function that times rounds of an AVX2 kernel in the given mode
+ * @param mode dependent or independent chains
+ * @param rounds Number of rounds of OSM_KERNEL_UNROLL operations
+ * @param value start of the chains
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+template <typename Op>
+static double time_chain (osm_chain_mode mode, unsigned int rounds, __m256i value)
+{
+  __m256i operand = _mm256_set1_epi32 (1);
+  uint64_t start = osm_region_begin ();
+  if (mode == OSM_CHAIN_DEPENDENT)
+    {
+      value = osm_dependent_chain<__m256i, Op, OSM_KERNEL_UNROLL> (rounds, value, operand);
+    }
+  else
+    {
+      value = osm_independent_chains<__m256i, Op, OSM_KERNEL_UNROLL> (rounds, value, operand);
+    }
+  uint64_t end = osm_region_end ();
+  osm_escape (value);
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+double osm_avx2_kernel (osm_kernel kernel, osm_chain_mode mode, unsigned int rounds)
+{
+  switch (kernel)
+    {
+      case OSM_KERNEL_AVX2_ADD:
+        return time_chain<Avx2Add> (mode, rounds, _mm256_setzero_si256 ());
+      case OSM_KERNEL_AVX2_MUL:
+        return time_chain<Avx2Mul> (mode, rounds, _mm256_set1_epi32 (1));
+      default:
+        return FAIL;
+    }
+}
+
+#else
+
+double osm_avx2_kernel (osm_kernel, osm_chain_mode, unsigned int)
+{
+  return FAIL;
+}
+
+#endif
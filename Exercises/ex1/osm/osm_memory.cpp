@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+#define CACHE_LINE 64
+#define CHASE_UNROLL 8
+#define CHASE_SEED 0x05a1u
+#define READ_LANES 4
+
+static const char *const BANDWIDTH_NAMES[OSM_BANDWIDTH_KIND_COUNT] = {
+    "read", "write", "copy"
+};
+
+/* keeps the results of the kernels alive */
+static volatile uint64_t sink;
+
+/**
+ * A pointer chasing working set and the position the chase stopped at
+ */
+struct Chain {
+    char *buffer;
+    size_t bytes;
+    void *position;
+};
+
+/**
+ * Buffers of a bandwidth kernel, dst is used only by the copy kernel
+ */
+struct Stream {
+    osm_bandwidth_kind kind;
+    char *src;
+    char *dst;
+    size_t bytes;
+    unsigned int pass;
+};
+
+/**
+ * Helper function that maps an anonymous buffer and touches all of its pages
+ * @param bytes size of the buffer
+ * @return the buffer in case of success, nullptr otherwise.
+ */
+static char *map_buffer (size_t bytes)
+{
+  void *buffer = mmap (nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED)
+    {
+      return nullptr;
+    }
+  memset (buffer, 0, bytes);
+  return (char *) buffer;
+}
+
+/* ----------------------------- latency ----------------------------------- */
+
+/**
+ * Helper function that links every cache line of the working set into a
+ * single cycle visiting the lines in a random order
+ * @param chain the chain, its buffer and bytes are set
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int build_chain (Chain *chain)
+{
+  size_t lines = chain->bytes / CACHE_LINE;
+  if (lines < 2 || lines > UINT32_MAX)
+    {
+      return FAIL;
+    }
+  std::vector<uint32_t> order (lines);
+  for (size_t i = 0; i < lines; i++)
+    {
+      order[i] = (uint32_t) i;
+    }
+  std::mt19937_64 generator (CHASE_SEED);
+  std::shuffle (order.begin (), order.end (), generator);
+  for (size_t i = 0; i < lines; i++)
+    {
+      char *line = chain->buffer + (size_t) order[i] * CACHE_LINE;
+      char *next = chain->buffer + (size_t) order[(i + 1) % lines] * CACHE_LINE;
+      *(void **) line = next;
+    }
+  chain->position = chain->buffer + (size_t) order[0] * CACHE_LINE;
+  return 0;
+}
+
+/**
+ * Follows the chain for the given number of loads. On x86-64 the loop is
+ * written in assembly so that the load to use dependency is the only thing
+ * measured, whatever the optimization level.
+ * @param position start of the chase
+ * @param loads Number of dependent loads
+ * @return the position the chase stopped at
+ */
+static void *chase (void *position, unsigned int loads)
+{
+  unsigned int rounds = loads / CHASE_UNROLL;
+  unsigned int rest = loads % CHASE_UNROLL;
+#if defined(__x86_64__)
+  if (rounds > 0)
+    {
+      asm volatile("1:\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "mov (%0), %0\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b"
+      : "+r" (position), "+r" (rounds)
+      :
+      : "memory", "cc");
+    }
+#else
+  rest += rounds * CHASE_UNROLL;
+#endif
+  for (unsigned int i = 0; i < rest; i++)
+    {
+      position = *(void **) position;
+    }
+  return position;
+}
+
+/**
+ * Harness trial of the pointer chase, continues from where the previous
+ * trial stopped
+ * @param iterations Number of loads
+ * @param arg Pointer to the Chain
+ * @return The time of a single load in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double latency_trial (unsigned int iterations, void *arg)
+{
+  Chain *chain = (Chain *) arg;
+  uint64_t start = osm_region_begin ();
+  chain->position = chase (chain->position, iterations);
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+int osm_memory_latency_stats (size_t bytes, const osm_config *config,
+                              osm_results *results)
+{
+  Chain chain = {nullptr, bytes, nullptr};
+  if (bytes < 2 * CACHE_LINE || (chain.buffer = map_buffer (bytes)) == nullptr)
+    {
+      return FAIL;
+    }
+  int ret = build_chain (&chain);
+  if (ret == 0)
+    {
+      ret = osm_measure (&latency_trial, &chain, config, results);
+    }
+  munmap (chain.buffer, bytes);
+  return ret;
+}
+
+int osm_memory_latency_curve (size_t min_bytes, size_t max_bytes,
+                              const osm_config *config, size_t sizes[],
+                              osm_results results[], int max_points)
+{
+  int points = 0;
+  for (size_t bytes = min_bytes; bytes > 0 && bytes <= max_bytes && points < max_points;
+       bytes *= 2)
+    {
+      if (osm_memory_latency_stats (bytes, config, &results[points]) == FAIL)
+        {
+          break;
+        }
+      sizes[points++] = bytes;
+    }
+  return points == 0 ? FAIL : points;
+}
+
+/* ----------------------------- bandwidth --------------------------------- */
+
+/**
+ * Sums the words of the buffer into independent lanes, so that the adds do
+ * not limit the rate of the loads
+ * @param words the buffer
+ * @param count Number of words
+ * @return the sum of the words
+ */
+static uint64_t read_kernel (const uint64_t *words, size_t count)
+{
+  uint64_t lanes[READ_LANES] = {0};
+  size_t i = 0;
+  for (; i + READ_LANES <= count; i += READ_LANES)
+    {
+      lanes[0] += words[i];
+      lanes[1] += words[i + 1];
+      lanes[2] += words[i + 2];
+      lanes[3] += words[i + 3];
+    }
+  for (; i < count; i++)
+    {
+      lanes[0] += words[i];
+    }
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/**
+ * Harness trial of a bandwidth kernel, every iteration is a full pass over
+ * the buffer
+ * @param iterations Number of passes
+ * @param arg Pointer to the Stream
+ * @return The time of a pass in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double bandwidth_trial (unsigned int iterations, void *arg)
+{
+  Stream *stream = (Stream *) arg;
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      switch (stream->kind)
+        {
+          case OSM_BANDWIDTH_READ:
+            sink = read_kernel ((const uint64_t *) stream->src, stream->bytes / sizeof (uint64_t));
+            break;
+          case OSM_BANDWIDTH_WRITE:
+            memset (stream->src, (int) (stream->pass++ & 0xff), stream->bytes);
+            break;
+          default:
+            memcpy (stream->dst, stream->src, stream->bytes);
+            break;
+        }
+    }
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+const char *osm_bandwidth_name (osm_bandwidth_kind kind)
+{
+  if (kind < 0 || kind >= OSM_BANDWIDTH_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return BANDWIDTH_NAMES[kind];
+}
+
+int osm_bandwidth_stats (osm_bandwidth_kind kind, size_t bytes,
+                         const osm_config *config, osm_results *results)
+{
+  if (kind < 0 || kind >= OSM_BANDWIDTH_KIND_COUNT || bytes < sizeof (uint64_t))
+    {
+      return FAIL;
+    }
+  Stream stream = {kind, map_buffer (bytes), nullptr, bytes, 0};
+  if (stream.src == nullptr)
+    {
+      return FAIL;
+    }
+  int ret = 0;
+  if (kind == OSM_BANDWIDTH_COPY && (stream.dst = map_buffer (bytes)) == nullptr)
+    {
+      ret = FAIL;
+    }
+  if (ret == 0)
+    {
+      /* an iteration streams the whole buffer, up to tens of mega-bytes */
+      osm_config bandwidth_config = osm_slow_config (config);
+      ret = osm_measure (&bandwidth_trial, &stream, &bandwidth_config, results);
+    }
+  if (ret == 0)
+    {
+      osm_scale_results (results, 1.0 / (double) bytes);
+    }
+  if (stream.dst != nullptr)
+    {
+      munmap (stream.dst, bytes);
+    }
+  munmap (stream.src, bytes);
+  return ret;
+}
@@ -0,0 +1,435 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+#define BASE_PAGE 4096
+#define DEFAULT_HUGE_PAGE (2u << 20)
+#define HUGE_PAGE_SIZE_FILE "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+#define SMAPS_FILE "/proc/self/smaps"
+#define SMAPS_LINE 256
+#define DEFAULT_TMPDIR "/var/tmp"
+#define FILE_CHUNK (1 << 20)
+#define FILE_FILL 0x5a
+
+static const char *const PAGING_NAMES[OSM_PAGING_KIND_COUNT] = {
+    "minor_fault", "major_fault", "mmap_munmap", "madvise_dontneed"
+};
+
+/* keeps the reads of the major faults alive */
+static volatile uint64_t sink;
+
+/**
+ * Arguments of a paging trial
+ */
+struct Paging {
+    osm_paging_kind kind;
+    osm_page_size page_size;
+    size_t bytes;
+    size_t huge_bytes;
+    int fd;
+};
+
+/**
+ * A mapping of anonymous memory, start is aligned to the page size of the
+ * benchmark
+ */
+struct Region {
+    char *base;
+    size_t mapped;
+    char *start;
+};
+
+/**
+ * Helper function that finds the size of a transparent huge page
+ * @return the size in bytes
+ */
+static size_t huge_page_size ()
+{
+  size_t bytes = 0;
+  FILE *file = fopen (HUGE_PAGE_SIZE_FILE, "r");
+  if (file != nullptr)
+    {
+      if (fscanf (file, "%zu", &bytes) != 1)
+        {
+          bytes = 0;
+        }
+      fclose (file);
+    }
+  return bytes == 0 ? DEFAULT_HUGE_PAGE : bytes;
+}
+
+/**
+ * Helper function that maps an untouched region of anonymous memory with
+ * the page size of the benchmark
+ * @param paging the benchmark
+ * @param region output
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int map_region (const Paging *paging, Region *region)
+{
+  bool huge = paging->page_size == OSM_PAGE_THP;
+  region->mapped = paging->bytes + (huge ? paging->huge_bytes : 0);
+  void *base = mmap (nullptr, region->mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    {
+      return FAIL;
+    }
+  region->base = (char *) base;
+  region->start = region->base;
+  if (huge)
+    {
+      uintptr_t aligned = ((uintptr_t) base + paging->huge_bytes - 1) & ~(uintptr_t) (paging->huge_bytes - 1);
+      region->start = (char *) aligned;
+      if (madvise (region->start, paging->bytes, MADV_HUGEPAGE) == FAIL)
+        {
+          munmap (region->base, region->mapped);
+          return FAIL;
+        }
+    }
+  else
+    {
+      /* fails harmlessly on kernels without transparent huge pages */
+      madvise (region->start, paging->bytes, MADV_NOHUGEPAGE);
+    }
+  return 0;
+}
+
+/**
+ * Helper function that writes a byte to every base page of the memory
+ * @param start the memory
+ * @param bytes size of the memory
+ */
+static void write_pages (char *start, size_t bytes)
+{
+  for (size_t offset = 0; offset < bytes; offset += BASE_PAGE)
+    {
+      ((volatile char *) start)[offset] = 1;
+    }
+}
+
+/**
+ * Helper function that reads a byte of every base page of the memory
+ * @param start the memory
+ * @param bytes size of the memory
+ */
+static void read_pages (const char *start, size_t bytes)
+{
+  uint64_t sum = 0;
+  for (size_t offset = 0; offset < bytes; offset += BASE_PAGE)
+    {
+      sum += ((const volatile char *) start)[offset];
+    }
+  sink = sum;
+}
+
+/**
+ * Helper function that reads the huge page memory of the mapping that holds
+ * an address, from /proc/self/smaps
+ * @param address the address
+ * @return the AnonHugePages of the mapping in kB, -1 if it was not found.
+ */
+static long anon_huge_kb (const void *address)
+{
+  FILE *file = fopen (SMAPS_FILE, "r");
+  if (file == nullptr)
+    {
+      return FAIL;
+    }
+  char line[SMAPS_LINE];
+  bool inside = false;
+  long kb = FAIL;
+  while (kb == FAIL && fgets (line, sizeof (line), file) != nullptr)
+    {
+      uintptr_t from, to;
+      long value;
+      if (sscanf (line, "%lx-%lx ", &from, &to) == 2)
+        {
+          inside = from <= (uintptr_t) address && (uintptr_t) address < to;
+        }
+      else if (inside && sscanf (line, "AnonHugePages: %ld kB", &value) == 1)
+        {
+          kb = value;
+        }
+    }
+  fclose (file);
+  return kb;
+}
+
+/**
+ * Helper function that checks that the huge page regions of the benchmark
+ * are actually backed by huge pages: madvise(MADV_HUGEPAGE) succeeds even
+ * when transparent huge pages are set to "never", and the benchmark would
+ * then measure base pages.
+ * @param paging a benchmark of OSM_PAGE_THP
+ * @return true if a touched region holds a huge page, false otherwise.
+ */
+static bool huge_pages_backed (const Paging *paging)
+{
+  Region region;
+  if (map_region (paging, &region) == FAIL)
+    {
+      return false;
+    }
+  write_pages (region.start, paging->huge_bytes);
+  long kb = anon_huge_kb (region.start);
+  munmap (region.base, region.mapped);
+  return kb > 0;
+}
+
+/**
+ * Helper function that checks that none of the pages of a file mapping are
+ * in the page cache
+ * @param start the mapping
+ * @param bytes size of the mapping
+ * @return true if all the pages were dropped, false otherwise.
+ */
+static bool evicted (char *start, size_t bytes)
+{
+  std::vector<unsigned char> resident (bytes / BASE_PAGE);
+  if (mincore (start, bytes, resident.data ()) == FAIL)
+    {
+      return false;
+    }
+  for (unsigned char page: resident)
+    {
+      if (page & 1)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+/**
+ * Helper function that times faults until at least the given number of
+ * pages were faulted in, a fresh mapping at a time
+ * @param paging the benchmark, a fault kind
+ * @param pages Number of pages
+ * @return The time of a single (4 KiB) page fault in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+static double fault_time (const Paging *paging, unsigned int pages)
+{
+  double total = 0;
+  size_t faulted = 0;
+  while (faulted < pages)
+    {
+      Region region{};
+      if (paging->kind == OSM_PAGING_MINOR_FAULT)
+        {
+          if (map_region (paging, &region) == FAIL)
+            {
+              return FAIL;
+            }
+        }
+      else
+        {
+          if (posix_fadvise (paging->fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+            {
+              return FAIL;
+            }
+          void *base = mmap (nullptr, paging->bytes, PROT_READ, MAP_SHARED, paging->fd, 0);
+          if (base == MAP_FAILED)
+            {
+              return FAIL;
+            }
+          region = {(char *) base, paging->bytes, (char *) base};
+          /* no readahead, so that every page is read by its own fault */
+          madvise (region.start, paging->bytes, MADV_RANDOM);
+          if (!evicted (region.start, paging->bytes))
+            {
+              munmap (region.base, region.mapped);
+              return FAIL;
+            }
+        }
+      uint64_t start = osm_region_begin ();
+      if (paging->kind == OSM_PAGING_MINOR_FAULT)
+        {
+          write_pages (region.start, paging->bytes);
+        }
+      else
+        {
+          read_pages (region.start, paging->bytes);
+        }
+      uint64_t end = osm_region_end ();
+      munmap (region.base, region.mapped);
+      if (start == 0 || end == 0)
+        {
+          return FAIL;
+        }
+      total += osm_timer_elapsed_ns (start, end);
+      faulted += paging->bytes / BASE_PAGE;
+    }
+  return total / (double) faulted;
+}
+
+/**
+ * Helper function that times pairs of mmap and munmap of untouched memory
+ * @param paging the benchmark
+ * @param iterations Number of pairs
+ * @return The time of a single pair in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double mmap_munmap_time (const Paging *paging, unsigned int iterations)
+{
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      void *base = mmap (nullptr, paging->bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED || munmap (base, paging->bytes) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+/**
+ * Helper function that times madvise(MADV_DONTNEED) of touched memory, the
+ * pages are touched again (untimed) before every call
+ * @param paging the benchmark
+ * @param iterations Number of calls
+ * @return The time of a single call in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double madvise_time (const Paging *paging, unsigned int iterations)
+{
+  Region region{};
+  if (map_region (paging, &region) == FAIL)
+    {
+      return FAIL;
+    }
+  double total = 0;
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      write_pages (region.start, paging->bytes);
+      uint64_t start = osm_region_begin ();
+      int ret = madvise (region.start, paging->bytes, MADV_DONTNEED);
+      uint64_t end = osm_region_end ();
+      if (ret == FAIL || start == 0 || end == 0)
+        {
+          total = FAIL;
+          break;
+        }
+      total += osm_timer_elapsed_ns (start, end);
+    }
+  munmap (region.base, region.mapped);
+  return total == FAIL ? FAIL : total / iterations;
+}
+
+/**
+ * Harness trial of a paging benchmark
+ * @param iterations Number of pages for the faults, of calls otherwise
+ * @param arg Pointer to the Paging
+ * @return The time of a single page fault or call in Nano-seconds in case
+ * of success, -1 otherwise.
+ */
+static double paging_trial (unsigned int iterations, void *arg)
+{
+  Paging *paging = (Paging *) arg;
+  switch (paging->kind)
+    {
+      case OSM_PAGING_MINOR_FAULT:
+      case OSM_PAGING_MAJOR_FAULT:
+        return fault_time (paging, iterations);
+      case OSM_PAGING_MMAP_MUNMAP:
+        return mmap_munmap_time (paging, iterations);
+      default:
+        return madvise_time (paging, iterations);
+    }
+}
+
+/**
+ * Helper function that creates an unlinked file of the given size whose
+ * pages are all written to the disk, so that they can be dropped from the
+ * page cache
+ * @param bytes size of the file
+ * @return the fd in case of success, -1 otherwise.
+ */
+static int create_file (size_t bytes)
+{
+  const char *directory = getenv ("TMPDIR");
+  std::string path = std::string (directory != nullptr ? directory : DEFAULT_TMPDIR)
+                     + "/osm_paging_XXXXXX";
+  int fd = mkstemp (&path[0]);
+  if (fd == FAIL)
+    {
+      return FAIL;
+    }
+  unlink (path.c_str ());
+  std::vector<char> chunk (FILE_CHUNK, FILE_FILL);
+  for (size_t written = 0; written < bytes;)
+    {
+      size_t size = bytes - written < chunk.size () ? bytes - written : chunk.size ();
+      ssize_t ret = write (fd, chunk.data (), size);
+      if (ret <= 0)
+        {
+          close (fd);
+          return FAIL;
+        }
+      written += (size_t) ret;
+    }
+  if (fdatasync (fd) == FAIL)
+    {
+      close (fd);
+      return FAIL;
+    }
+  return fd;
+}
+
+const char *osm_paging_name (osm_paging_kind kind)
+{
+  if (kind < 0 || kind >= OSM_PAGING_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return PAGING_NAMES[kind];
+}
+
+int osm_paging_stats (osm_paging_kind kind, osm_page_size page_size, size_t bytes,
+                      const osm_config *config, osm_results *results)
+{
+  Paging paging = {kind, page_size, (bytes + BASE_PAGE - 1) / BASE_PAGE * BASE_PAGE,
+                   huge_page_size (), FAIL};
+  if (kind < 0 || kind >= OSM_PAGING_KIND_COUNT || bytes == 0
+      || (page_size != OSM_PAGE_4K && page_size != OSM_PAGE_THP))
+    {
+      return FAIL;
+    }
+  if (page_size == OSM_PAGE_THP
+      && (kind == OSM_PAGING_MAJOR_FAULT || kind == OSM_PAGING_MMAP_MUNMAP
+          || paging.bytes < paging.huge_bytes || !huge_pages_backed (&paging)))
+    {
+      return FAIL;
+    }
+  if (kind == OSM_PAGING_MAJOR_FAULT && (paging.fd = create_file (paging.bytes)) == FAIL)
+    {
+      return FAIL;
+    }
+  /* every operation takes micro-seconds and some need untimed preparation
+     (mapping, touching) */
+  osm_config paging_config = osm_slow_config (config);
+  int ret = osm_measure (&paging_trial, &paging, &paging_config, results);
+  if (paging.fd != FAIL)
+    {
+      close (paging.fd);
+    }
+  return ret;
+}
@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <vector>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+#include "osm_cpu.h"
+
+#define FAIL -1
+#define ORIGINAL_MASK -1
+#define DELIVERIES_PER_ROUND_TRIP 2
+#define MICRO_TO_NANO 1000.0
+#define SEC_TO_NANO 1e9
+#define SEC_TO_MICRO 1000000
+#define TIMEOUT_FACTOR 4
+/* the longest scheduler tick (HZ = 100) */
+#define COARSEST_TICK_US 10000u
+
+static const char *const SIGNAL_NAMES[OSM_SIGNAL_KIND_COUNT] = {
+    "self", "thread"
+};
+
+static const char *const INTERVAL_TIMER_NAMES[OSM_INTERVAL_TIMER_COUNT] = {
+    "itimer_real", "itimer_virtual", "itimer_prof", "posix_timer", "timerfd"
+};
+
+/**
+ * Arguments of a single signal trial
+ */
+struct SignalTrial {
+    osm_signal_kind kind;
+    osm_placement placement;
+};
+
+/**
+ * State shared by the two threads of the signal ping-pong, the peer answers
+ * rounds signals and exits.
+ */
+struct SignalPeer {
+    unsigned int rounds;
+    pthread_t caller;
+    sigset_t wait_mask;
+};
+
+/**
+ * An armed interval timer
+ */
+struct TimerSource {
+    osm_interval_timer timer;
+    int signal;
+    timer_t posix;
+    int fd;
+};
+
+/* signals caught by the calling thread, per thread */
+static thread_local volatile sig_atomic_t delivered;
+
+/* expirations of the timer recorded by the handler */
+static std::atomic<unsigned int> ticks_seen;
+static uint64_t *tick_stamps;
+static unsigned int max_ticks;
+
+/* -------------------------------- delivery -------------------------------- */
+
+/**
+ * Handler of the delivery benchmarks
+ */
+static void delivery_handler (int)
+{
+  delivered = delivered + 1;
+}
+
+/**
+ * Helper function that waits in sigsuspend until the next signal is caught
+ * @param wait_mask mask without the signal
+ */
+static void wait_signal (const sigset_t *wait_mask)
+{
+  sig_atomic_t seen = delivered;
+  while (delivered == seen)
+    {
+      sigsuspend (wait_mask);
+    }
+}
+
+/**
+ * Peer side of the signal ping-pong
+ * @param arg SignalPeer
+ * @return nullptr
+ */
+static void *signal_peer (void *arg)
+{
+  SignalPeer *peer = (SignalPeer *) arg;
+  for (unsigned int i = 0; i < peer->rounds; i++)
+    {
+      wait_signal (&peer->wait_mask);
+      pthread_kill (peer->caller, SIGUSR1);
+    }
+  return nullptr;
+}
+
+/**
+ * Helper function that times raise() of a caught signal
+ * @param iterations Number of signals
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double self_rounds (unsigned int iterations)
+{
+  sigset_t unblock;
+  sigemptyset (&unblock);
+  sigaddset (&unblock, SIGUSR1);
+  sigset_t old_mask;
+  pthread_sigmask (SIG_UNBLOCK, &unblock, &old_mask);
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      raise (SIGUSR1);
+    }
+  uint64_t end = osm_region_end ();
+  pthread_sigmask (SIG_SETMASK, &old_mask, nullptr);
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/**
+ * Helper function that times round trips of a signal between the calling
+ * thread and a peer pthread pinned to peer_cpu. The signal is blocked
+ * outside sigsuspend, so none is lost. The first round trip is not timed so
+ * that the thread creation is left out.
+ * @param iterations Number of round trips
+ * @param peer_cpu CPU of the peer thread
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double thread_rounds (unsigned int iterations, int peer_cpu)
+{
+  sigset_t block;
+  sigemptyset (&block);
+  sigaddset (&block, SIGUSR1);
+  sigset_t old_mask;
+  pthread_sigmask (SIG_BLOCK, &block, &old_mask);
+  SignalPeer peer;
+  peer.rounds = iterations + 1;
+  peer.caller = pthread_self ();
+  peer.wait_mask = old_mask;
+  sigdelset (&peer.wait_mask, SIGUSR1);
+
+  cpu_set_t mask;
+  CPU_ZERO (&mask);
+  CPU_SET (peer_cpu, &mask);
+  pthread_attr_t attr;
+  pthread_attr_init (&attr);
+  pthread_attr_setaffinity_np (&attr, sizeof (mask), &mask);
+  pthread_t thread;
+  int created = pthread_create (&thread, &attr, &signal_peer, &peer);
+  pthread_attr_destroy (&attr);
+  if (created != 0)
+    {
+      pthread_sigmask (SIG_SETMASK, &old_mask, nullptr);
+      return FAIL;
+    }
+
+  pthread_kill (thread, SIGUSR1);
+  wait_signal (&peer.wait_mask);
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      pthread_kill (thread, SIGUSR1);
+      wait_signal (&peer.wait_mask);
+    }
+  uint64_t end = osm_region_end ();
+  pthread_join (thread, nullptr);
+  pthread_sigmask (SIG_SETMASK, &old_mask, nullptr);
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/**
+ * Harness trial of a signal delivery path. The calling thread is pinned to
+ * the first allowed CPU for the duration of the trial.
+ * @param iterations Number of signals (round trips for OSM_SIGNAL_THREAD)
+ * @param arg Pointer to the SignalTrial
+ * @return The time of a single iteration (a delivery, or a round trip of
+ * two deliveries for OSM_SIGNAL_THREAD) in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double signal_trial (unsigned int iterations, void *arg)
+{
+  SignalTrial *trial = (SignalTrial *) arg;
+  int cpu = osm_cpu_allowed (0);
+  int peer_cpu = osm_cpu_allowed (trial->placement == OSM_CROSS_CORE ? 1 : 0);
+  if (cpu == FAIL || peer_cpu == FAIL || osm_pin_thread (cpu) == FAIL)
+    {
+      return FAIL;
+    }
+  double elapsed = trial->kind == OSM_SIGNAL_SELF ? self_rounds (iterations)
+                                                  : thread_rounds (iterations, peer_cpu);
+  osm_pin_thread (ORIGINAL_MASK);
+  if (elapsed == FAIL)
+    {
+      return FAIL;
+    }
+  return elapsed / iterations;
+}
+
+const char *osm_signal_name (osm_signal_kind kind)
+{
+  if (kind < 0 || kind >= OSM_SIGNAL_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return SIGNAL_NAMES[kind];
+}
+
+int osm_signal_stats (osm_signal_kind kind, osm_placement placement,
+                      const osm_config *config, osm_results *results)
+{
+  if (kind < 0 || kind >= OSM_SIGNAL_KIND_COUNT
+      || (kind == OSM_SIGNAL_SELF && placement == OSM_CROSS_CORE))
+    {
+      return FAIL;
+    }
+  struct sigaction action = {};
+  action.sa_handler = &delivery_handler;
+  sigemptyset (&action.sa_mask);
+  struct sigaction old_action;
+  if (sigaction (SIGUSR1, &action, &old_action) == FAIL)
+    {
+      return FAIL;
+    }
+  SignalTrial trial = {kind, placement};
+  int ret = osm_measure (&signal_trial, &trial, config, results);
+  if (ret == 0 && kind == OSM_SIGNAL_THREAD)
+    {
+      /* the counters are per iteration too, so both are scaled together */
+      osm_scale_results (results, 1.0 / DELIVERIES_PER_ROUND_TRIP);
+    }
+  sigaction (SIGUSR1, &old_action, nullptr);
+  return ret;
+}
+
+/* --------------------------------- timers --------------------------------- */
+
+/**
+ * Handler of the signal timers, records the time of the expiration
+ */
+static void tick_handler (int)
+{
+  unsigned int tick = ticks_seen.load (std::memory_order_relaxed);
+  if (tick < max_ticks)
+    {
+      tick_stamps[tick] = osm_timer_read ();
+    }
+  ticks_seen.store (tick + 1, std::memory_order_relaxed);
+}
+
+/**
+ * Helper function that finds the signal of a timer
+ * @param timer the timer
+ * @return the signal, 0 for OSM_TIMERFD
+ */
+static int signal_of (osm_interval_timer timer)
+{
+  switch (timer)
+    {
+      case OSM_ITIMER_REAL:
+        return SIGALRM;
+      case OSM_ITIMER_VIRTUAL:
+        return SIGVTALRM;
+      case OSM_ITIMER_PROF:
+        return SIGPROF;
+      case OSM_POSIX_TIMER:
+        return SIGRTMIN;
+      default:
+        return 0;
+    }
+}
+
+/**
+ * Helper function that finds the setitimer timer of a timer
+ * @param timer one of the OSM_ITIMER timers
+ * @return the setitimer timer
+ */
+static int itimer_of (osm_interval_timer timer)
+{
+  return timer == OSM_ITIMER_REAL ? ITIMER_REAL
+                                  : (timer == OSM_ITIMER_VIRTUAL ? ITIMER_VIRTUAL : ITIMER_PROF);
+}
+
+/**
+ * Helper function that arms a periodic timer
+ * @param source the timer, its signal and timer fields are set
+ * @param quantum_us period of the timer in micro-seconds
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int start_timer (TimerSource *source, unsigned int quantum_us)
+{
+  struct timespec period = {(time_t) (quantum_us / SEC_TO_MICRO),
+                            (long) (quantum_us % SEC_TO_MICRO) * 1000};
+  struct itimerspec spec = {period, period};
+  switch (source->timer)
+    {
+      case OSM_POSIX_TIMER:
+        {
+          struct sigevent event = {};
+          event.sigev_notify = SIGEV_SIGNAL;
+          event.sigev_signo = source->signal;
+          if (timer_create (CLOCK_MONOTONIC, &event, &source->posix) == FAIL)
+            {
+              return FAIL;
+            }
+          if (timer_settime (source->posix, 0, &spec, nullptr) == FAIL)
+            {
+              timer_delete (source->posix);
+              return FAIL;
+            }
+          return 0;
+        }
+      case OSM_TIMERFD:
+        source->fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (source->fd == FAIL)
+          {
+            return FAIL;
+          }
+        if (timerfd_settime (source->fd, 0, &spec, nullptr) == FAIL)
+          {
+            close (source->fd);
+            return FAIL;
+          }
+        return 0;
+      default:
+        {
+          struct timeval interval = {(time_t) (quantum_us / SEC_TO_MICRO),
+                                     (suseconds_t) (quantum_us % SEC_TO_MICRO)};
+          struct itimerval timer = {interval, interval};
+          return setitimer (itimer_of (source->timer), &timer, nullptr);
+        }
+    }
+}
+
+/**
+ * Helper function that disarms a timer armed by start_timer
+ * @param source the timer
+ */
+static void stop_timer (TimerSource *source)
+{
+  switch (source->timer)
+    {
+      case OSM_POSIX_TIMER:
+        timer_delete (source->posix);
+        break;
+      case OSM_TIMERFD:
+        close (source->fd);
+        break;
+      default:
+        {
+          struct itimerval timer = {};
+          setitimer (itimer_of (source->timer), &timer, nullptr);
+        }
+    }
+}
+
+/**
+ * Spins reading the timer until the handler recorded target expirations or
+ * the timeout passed. The gap between two readings around an expiration is
+ * the time the expiration took away from the spinning.
+ * @param target expirations to wait for
+ * @param timeout_ns timeout in nano-seconds
+ * @param gaps output, the gap around every expiration (may be nullptr)
+ * @param gap_count output, number of gaps written (at most max_gaps)
+ * @param max_gaps size of gaps
+ * @param shortest output, the shortest gap between two readings
+ */
+static void spin (unsigned int target, double timeout_ns, double *gaps,
+                  unsigned int *gap_count, unsigned int max_gaps, double *shortest)
+{
+  uint64_t start = osm_timer_read ();
+  uint64_t previous = start;
+  unsigned int seen = ticks_seen.load (std::memory_order_relaxed);
+  /* the handler may run after the reading that sees its expiration, so the
+     gap of the following reading counts too */
+  double pending = -1;
+  *gap_count = 0;
+  *shortest = timeout_ns;
+  while (seen < target || pending >= 0)
+    {
+      uint64_t now = osm_timer_read ();
+      double gap = osm_timer_elapsed_ns (previous, now);
+      unsigned int ticks = ticks_seen.load (std::memory_order_relaxed);
+      if (pending >= 0)
+        {
+          if (gaps != nullptr && *gap_count < max_gaps)
+            {
+              gaps[(*gap_count)++] = std::max (pending, gap);
+            }
+          pending = -1;
+        }
+      else if (ticks == seen && gap < *shortest)
+        {
+          *shortest = gap;
+        }
+      if (ticks != seen)
+        {
+          pending = gap;
+          seen = ticks;
+        }
+      if (osm_timer_elapsed_ns (start, now) > timeout_ns)
+        {
+          break;
+        }
+      previous = now;
+    }
+}
+
+/**
+ * Helper function that finds the CPU time of the calling thread
+ * @return the CPU time in nano-seconds
+ */
+static double thread_cpu_ns ()
+{
+  struct timespec now;
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+  return (double) now.tv_sec * SEC_TO_NANO + (double) now.tv_nsec;
+}
+
+/**
+ * Helper function that records the expirations of a signal timer while
+ * spinning, and finds the time a single expiration takes away from the
+ * spinning
+ * @param source the timer
+ * @param quantum_us period of the timer in micro-seconds
+ * @param stamps number of expirations to record
+ * @param tick_cost output, time lost per expiration in nano-seconds
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int record_signals (TimerSource *source, unsigned int quantum_us,
+                           unsigned int stamps, double *tick_cost)
+{
+  /* the virtual and profiling timers expire at most once per scheduler tick */
+  double period_us = quantum_us > COARSEST_TICK_US ? quantum_us : COARSEST_TICK_US;
+  double timeout_ns = TIMEOUT_FACTOR * (double) stamps * period_us * MICRO_TO_NANO + SEC_TO_NANO;
+  struct sigaction action = {};
+  action.sa_handler = &tick_handler;
+  sigemptyset (&action.sa_mask);
+  struct sigaction old_action;
+  if (sigaction (source->signal, &action, &old_action) == FAIL)
+    {
+      return FAIL;
+    }
+  sigset_t unblock;
+  sigemptyset (&unblock);
+  sigaddset (&unblock, source->signal);
+  sigset_t old_mask;
+  pthread_sigmask (SIG_UNBLOCK, &unblock, &old_mask);
+  int ret = start_timer (source, quantum_us);
+  if (ret == 0)
+    {
+      /* from the first expiration, so that arming is left out */
+      std::vector<double> gaps (stamps);
+      unsigned int gap_count;
+      double shortest;
+      spin (1, timeout_ns, nullptr, &gap_count, 0, &shortest);
+      spin (stamps, timeout_ns, gaps.data (), &gap_count, stamps, &shortest);
+      stop_timer (source);
+      ret = ticks_seen.load () >= stamps ? 0 : FAIL;
+      if (ret == 0 && gap_count > 0)
+        {
+          /* the median is not affected by the occasional preemption */
+          std::nth_element (gaps.begin (), gaps.begin () + gap_count / 2, gaps.begin () + gap_count);
+          double cost = gaps[gap_count / 2] - shortest;
+          *tick_cost = cost > 0 ? cost : 0;
+        }
+    }
+  /* an expiration may still be pending, it must not reach the old handler */
+  pthread_sigmask (SIG_BLOCK, &unblock, nullptr);
+  struct timespec no_wait = {0, 0};
+  while (sigtimedwait (&unblock, nullptr, &no_wait) > 0)
+    {}
+  pthread_sigmask (SIG_SETMASK, &old_mask, nullptr);
+  sigaction (source->signal, &old_action, nullptr);
+  return ret;
+}
+
+/**
+ * Helper function that records the expirations of a timerfd
+ * @param source the timer
+ * @param quantum_us period of the timer in micro-seconds
+ * @param stamps number of expirations to record
+ * @param tick_cost output, CPU time per expiration in nano-seconds
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int record_timerfd (TimerSource *source, unsigned int quantum_us,
+                           unsigned int stamps, double *tick_cost)
+{
+  if (start_timer (source, quantum_us) == FAIL)
+    {
+      return FAIL;
+    }
+  uint64_t expirations;
+  int ret = read (source->fd, &expirations, sizeof (expirations)) == sizeof (expirations) ? 0 : FAIL;
+  double cpu_start = thread_cpu_ns ();
+  for (unsigned int tick = 0; ret == 0 && tick < stamps; tick++)
+    {
+      if (read (source->fd, &expirations, sizeof (expirations)) != sizeof (expirations))
+        {
+          ret = FAIL;
+          break;
+        }
+      tick_stamps[tick] = osm_timer_read ();
+    }
+  *tick_cost = (thread_cpu_ns () - cpu_start) / stamps;
+  stop_timer (source);
+  return ret;
+}
+
+const char *osm_interval_timer_name (osm_interval_timer timer)
+{
+  if (timer < 0 || timer >= OSM_INTERVAL_TIMER_COUNT)
+    {
+      return nullptr;
+    }
+  return INTERVAL_TIMER_NAMES[timer];
+}
+
+int osm_timer_jitter (osm_interval_timer timer, unsigned int quantum_us,
+                      unsigned int ticks, osm_results *results, double *tick_cost)
+{
+  if (timer < 0 || timer >= OSM_INTERVAL_TIMER_COUNT || quantum_us == 0 || ticks == 0
+      || results == nullptr)
+    {
+      return FAIL;
+    }
+  unsigned int stamps = ticks + 1;
+  std::vector<uint64_t> recorded (stamps);
+  tick_stamps = recorded.data ();
+  max_ticks = stamps;
+  ticks_seen.store (0);
+  TimerSource source = {timer, signal_of (timer), timer_t (), FAIL};
+  double cost = 0;
+  int ret = timer == OSM_TIMERFD ? record_timerfd (&source, quantum_us, stamps, &cost)
+                                 : record_signals (&source, quantum_us, stamps, &cost);
+  max_ticks = 0;
+  if (ret == FAIL)
+    {
+      return FAIL;
+    }
+
+  std::vector<double> errors (ticks);
+  double quantum_ns = quantum_us * MICRO_TO_NANO;
+  for (unsigned int tick = 0; tick < ticks; tick++)
+    {
+      errors[tick] = osm_timer_elapsed_ns (recorded[tick], recorded[tick + 1]) - quantum_ns;
+    }
+  if (osm_summarize (errors.data (), ticks, 0, ticks, results) == FAIL)
+    {
+      return FAIL;
+    }
+  if (tick_cost != nullptr)
+    {
+      *tick_cost = cost;
+    }
+  return 0;
+}
@@ -0,0 +1,315 @@
+#include <atomic>
+#include <csetjmp>
+#include <cstdlib>
+#include <new>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+#define CLONE_STACK_ALIGN 16
+#define SPAWNED_PROGRAM "/bin/true"
+#define NAMESPACE_FLAGS (CLONE_NEWUTS | CLONE_NEWPID | CLONE_NEWNS)
+
+typedef unsigned long address_t;
+#define JB_SP 6
+#define JB_PC 7
+
+extern char **environ;
+
+static const char *const SPAWN_NAMES[OSM_SPAWN_KIND_COUNT] = {
+    "pthread", "fork", "vfork", "posix_spawn", "clone", "clone_ns", "uthread"
+};
+
+/**
+ * Arguments of a spawn trial
+ */
+struct SpawnTrial {
+    osm_spawn_kind kind;
+    size_t stack_size;
+};
+
+static std::atomic<bool> load_stop;
+static sigjmp_buf spawner_env;
+static sigjmp_buf uthread_env;
+
+/**
+ * Entry point of the spawned pthreads
+ * @return nullptr
+ */
+static void *empty_thread (void *)
+{
+  return nullptr;
+}
+
+/**
+ * Entry point of the cloned processes
+ * @return the exit status
+ */
+static int empty_child (void *)
+{
+  return 0;
+}
+
+/**
+ * Entry point of the busy threads
+ * @return nullptr
+ */
+static void *load_thread (void *)
+{
+  while (!load_stop.load (std::memory_order_relaxed))
+    {}
+  return nullptr;
+}
+
+/* ------------------------------ kernel level ------------------------------ */
+
+/**
+ * Helper function that creates and joins a pthread
+ * @param stack_size stack of the thread, 0 for the default
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int spawn_pthread (size_t stack_size)
+{
+  pthread_attr_t attr;
+  pthread_attr_init (&attr);
+  if (stack_size != 0 && pthread_attr_setstacksize (&attr, stack_size) != 0)
+    {
+      pthread_attr_destroy (&attr);
+      return FAIL;
+    }
+  pthread_t thread;
+  int ret = pthread_create (&thread, &attr, &empty_thread, nullptr);
+  pthread_attr_destroy (&attr);
+  if (ret != 0)
+    {
+      return FAIL;
+    }
+  return pthread_join (thread, nullptr) == 0 ? 0 : FAIL;
+}
+
+/**
+ * Helper function that waits for a child that exits with status 0
+ * @param pid the child
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int wait_child (pid_t pid)
+{
+  int status;
+  if (pid == FAIL || waitpid (pid, &status, 0) != pid)
+    {
+      return FAIL;
+    }
+  return WIFEXITED (status) && WEXITSTATUS (status) == 0 ? 0 : FAIL;
+}
+
+/**
+ * Helper function that clones a process on a stack of the given size, the
+ * same way the container of ex5 does
+ * @param stack_size stack of the child
+ * @param flags namespace flags of the child
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int spawn_clone (size_t stack_size, int flags)
+{
+  char *stack = (char *) malloc (stack_size);
+  if (stack == nullptr)
+    {
+      return FAIL;
+    }
+  char *top = (char *) ((uintptr_t) (stack + stack_size) & ~(uintptr_t) (CLONE_STACK_ALIGN - 1));
+  int ret = wait_child (clone (&empty_child, top, flags | SIGCHLD, nullptr));
+  free (stack);
+  return ret;
+}
+
+/**
+ * Helper function that spawns /bin/true and waits for it
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int spawn_program ()
+{
+  char program[] = SPAWNED_PROGRAM;
+  char *argv[] = {program, nullptr};
+  pid_t pid;
+  if (posix_spawn (&pid, SPAWNED_PROGRAM, nullptr, nullptr, argv, environ) != 0)
+    {
+      return FAIL;
+    }
+  return wait_child (pid);
+}
+
+/* ------------------------------- user level ------------------------------- */
+
+#if defined(__x86_64__)
+/* A translation is required when using an address of a variable.
+   glibc mangles the saved stack and program pointers. */
+static address_t translate_address (address_t addr)
+{
+  address_t ret;
+  asm volatile("xor    %%fs:0x30,%0\n"
+               "rol    $0x11,%0\n"
+  : "=g" (ret)
+  : "0" (addr));
+  return ret;
+}
+#endif
+
+/**
+ * Entry point of the user-level threads, terminates right away by jumping
+ * back to the spawner
+ */
+static void empty_uthread ()
+{
+  siglongjmp (spawner_env, 1);
+}
+
+/**
+ * Helper function that spawns a user-level thread the way the uthreads
+ * library does: its stack is allocated, its environment points to the stack
+ * and the entry point, it runs until it terminates and its stack is deleted
+ * @param stack_size stack of the thread
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int spawn_uthread (size_t stack_size)
+{
+#if defined(__x86_64__)
+  char *stack = new (std::nothrow) char[stack_size];
+  if (stack == nullptr)
+    {
+      return FAIL;
+    }
+  address_t sp = (address_t) stack + stack_size - sizeof (address_t);
+  address_t pc = (address_t) &empty_uthread;
+  sigsetjmp (uthread_env, 1);
+  (uthread_env->__jmpbuf)[JB_SP] = translate_address (sp);
+  (uthread_env->__jmpbuf)[JB_PC] = translate_address (pc);
+  sigemptyset (&uthread_env->__saved_mask);
+  if (sigsetjmp (spawner_env, 1) == 0)
+    {
+      siglongjmp (uthread_env, 1);
+    }
+  delete[] stack;
+  return 0;
+#else
+  (void) stack_size;
+  return FAIL;
+#endif
+}
+
+/* --------------------------------- trial ---------------------------------- */
+
+/**
+ * Helper function that spawns a single context and waits for it
+ * @param trial the spawn mechanism
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int spawn_once (const SpawnTrial *trial)
+{
+  pid_t pid;
+  switch (trial->kind)
+    {
+      case OSM_SPAWN_PTHREAD:
+        return spawn_pthread (trial->stack_size);
+      case OSM_SPAWN_FORK:
+        pid = fork ();
+        if (pid == 0)
+          {
+            _exit (0);
+          }
+        return wait_child (pid);
+      case OSM_SPAWN_VFORK:
+        pid = vfork ();
+        if (pid == 0)
+          {
+            _exit (0);
+          }
+        return wait_child (pid);
+      case OSM_SPAWN_POSIX_SPAWN:
+        return spawn_program ();
+      case OSM_SPAWN_CLONE:
+        return spawn_clone (trial->stack_size, 0);
+      case OSM_SPAWN_CLONE_NS:
+        return spawn_clone (trial->stack_size, NAMESPACE_FLAGS);
+      default:
+        return spawn_uthread (trial->stack_size);
+    }
+}
+
+/**
+ * Harness trial of a spawn mechanism
+ * @param iterations Number of contexts
+ * @param arg Pointer to the SpawnTrial
+ * @return The time of a single spawn in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double spawn_trial (unsigned int iterations, void *arg)
+{
+  SpawnTrial *trial = (SpawnTrial *) arg;
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      if (spawn_once (trial) == FAIL)
+        {
+          return FAIL;
+        }
+    }
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+const char *osm_spawn_name (osm_spawn_kind kind)
+{
+  if (kind < 0 || kind >= OSM_SPAWN_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return SPAWN_NAMES[kind];
+}
+
+int osm_spawn_stats (osm_spawn_kind kind, size_t stack_size, int load_threads,
+                     const osm_config *config, osm_results *results)
+{
+  bool own_stack = kind == OSM_SPAWN_CLONE || kind == OSM_SPAWN_CLONE_NS
+                   || kind == OSM_SPAWN_UTHREAD;
+  if (kind < 0 || kind >= OSM_SPAWN_KIND_COUNT || load_threads < 0
+      || load_threads > OSM_MAX_LOAD_THREADS || (own_stack && stack_size < CLONE_STACK_ALIGN))
+    {
+      return FAIL;
+    }
+  load_stop.store (false);
+  pthread_t loaders[OSM_MAX_LOAD_THREADS];
+  int started = 0;
+  for (; started < load_threads; started++)
+    {
+      if (pthread_create (&loaders[started], nullptr, &load_thread, nullptr) != 0)
+        {
+          break;
+        }
+    }
+  int ret = FAIL;
+  if (started == load_threads)
+    {
+      SpawnTrial trial = {kind, stack_size};
+      osm_config spawn_config = osm_slow_config (config);
+      ret = osm_measure (&spawn_trial, &trial, &spawn_config, results);
+    }
+  load_stop.store (true);
+  for (int i = 0; i < started; i++)
+    {
+      pthread_join (loaders[i], nullptr);
+    }
+  return ret;
+}
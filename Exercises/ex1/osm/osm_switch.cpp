@@ -0,0 +1,425 @@
+#include <atomic>
+#include <csetjmp>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+#include "osm_cpu.h"
+
+#define FAIL -1
+#define SWITCHES_PER_ROUND_TRIP 2
+#define PEER_STACK_SIZE 65536
+#define ORIGINAL_MASK -1
+
+typedef unsigned long address_t;
+#define JB_SP 6
+#define JB_PC 7
+
+static const char *const SWITCH_NAMES[OSM_SWITCH_KIND_COUNT] = {
+    "sigjmp_mask", "sigjmp_nomask", "condvar", "futex", "pipe_process"
+};
+
+/**
+ * Arguments of a single switch trial
+ */
+struct SwitchTrial {
+    osm_switch_kind kind;
+    osm_placement placement;
+};
+
+/**
+ * State shared by the two pthreads of a handoff, the peer answers
+ * rounds round trips and exits.
+ */
+struct Handoff {
+    unsigned int rounds;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int turn;
+    std::atomic<int> word;
+};
+
+static sigjmp_buf main_env;
+static sigjmp_buf peer_env;
+static int jmp_save_mask;
+alignas(16) static char peer_stack[PEER_STACK_SIZE];
+
+/* ---------------------------- sigsetjmp switch ---------------------------- */
+
+#if defined(__x86_64__)
+/* A translation is required when using an address of a variable.
+   glibc mangles the saved stack and program pointers. */
+static address_t translate_address (address_t addr)
+{
+  address_t ret;
+  asm volatile("xor    %%fs:0x30,%0\n"
+               "rol    $0x11,%0\n"
+  : "=g" (ret)
+  : "0" (addr));
+  return ret;
+}
+#endif
+
+/**
+ * Entry point of the peer context, bounces every switch straight back
+ */
+static void sigjmp_peer ()
+{
+  for (;;)
+    {
+      if (sigsetjmp (peer_env, jmp_save_mask) == 0)
+        {
+          siglongjmp (main_env, 1);
+        }
+    }
+}
+
+/**
+ * Helper function that makes one round trip to the peer context. It is a
+ * function of its own so that no local of the timing loop lives across
+ * the jumps.
+ * @param save_mask the savemask argument of sigsetjmp
+ */
+__attribute__((noinline)) static void sigjmp_round (int save_mask)
+{
+  if (sigsetjmp (main_env, save_mask) == 0)
+    {
+      siglongjmp (peer_env, 1);
+    }
+}
+
+/**
+ * Helper function that times round trips between the calling context and
+ * a peer context on its own stack, the same way the uthreads library
+ * switches threads
+ * @param iterations Number of round trips
+ * @param save_mask the savemask argument of sigsetjmp
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double sigjmp_rounds (unsigned int iterations, int save_mask)
+{
+#if defined(__x86_64__)
+  jmp_save_mask = save_mask;
+  address_t sp = (address_t) peer_stack + PEER_STACK_SIZE - sizeof (address_t);
+  address_t pc = (address_t) &sigjmp_peer;
+  sigsetjmp (peer_env, save_mask);
+  (peer_env->__jmpbuf)[JB_SP] = translate_address (sp);
+  (peer_env->__jmpbuf)[JB_PC] = translate_address (pc);
+  if (sigsetjmp (main_env, save_mask) == 0)
+    {
+      siglongjmp (peer_env, 1);
+    }
+  uint64_t start = osm_region_begin ();
+  for (unsigned int i = 0; i < iterations; i++)
+    {
+      sigjmp_round (save_mask);
+    }
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+#else
+  (void) iterations;
+  (void) save_mask;
+  return FAIL;
+#endif
+}
+
+/* ---------------------------- pthread handoffs ---------------------------- */
+
+/**
+ * Waits on the futex while it holds value
+ * @param word futex word
+ * @param value expected value
+ */
+static void futex_wait (std::atomic<int> *word, int value)
+{
+  syscall (SYS_futex, (int *) word, FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+/**
+ * Wakes a single waiter of the futex
+ * @param word futex word
+ */
+static void futex_wake (std::atomic<int> *word)
+{
+  syscall (SYS_futex, (int *) word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+/**
+ * Peer side of the condition variable handoff
+ * @param arg Handoff
+ * @return nullptr
+ */
+static void *condvar_peer (void *arg)
+{
+  Handoff *handoff = (Handoff *) arg;
+  pthread_mutex_lock (&handoff->mutex);
+  for (unsigned int i = 0; i < handoff->rounds; i++)
+    {
+      while (handoff->turn != 1)
+        {
+          pthread_cond_wait (&handoff->cond, &handoff->mutex);
+        }
+      handoff->turn = 0;
+      pthread_cond_signal (&handoff->cond);
+    }
+  pthread_mutex_unlock (&handoff->mutex);
+  return nullptr;
+}
+
+/**
+ * Calling side of the condition variable handoff
+ * @param handoff shared state
+ * @param rounds Number of round trips
+ */
+static void condvar_rounds (Handoff *handoff, unsigned int rounds)
+{
+  pthread_mutex_lock (&handoff->mutex);
+  for (unsigned int i = 0; i < rounds; i++)
+    {
+      handoff->turn = 1;
+      pthread_cond_signal (&handoff->cond);
+      while (handoff->turn != 0)
+        {
+          pthread_cond_wait (&handoff->cond, &handoff->mutex);
+        }
+    }
+  pthread_mutex_unlock (&handoff->mutex);
+}
+
+/**
+ * Peer side of the futex handoff
+ * @param arg Handoff
+ * @return nullptr
+ */
+static void *futex_peer (void *arg)
+{
+  Handoff *handoff = (Handoff *) arg;
+  for (unsigned int i = 0; i < handoff->rounds; i++)
+    {
+      while (handoff->word.load () != 1)
+        {
+          futex_wait (&handoff->word, 0);
+        }
+      handoff->word.store (0);
+      futex_wake (&handoff->word);
+    }
+  return nullptr;
+}
+
+/**
+ * Calling side of the futex handoff
+ * @param handoff shared state
+ * @param rounds Number of round trips
+ */
+static void futex_rounds (Handoff *handoff, unsigned int rounds)
+{
+  for (unsigned int i = 0; i < rounds; i++)
+    {
+      handoff->word.store (1);
+      futex_wake (&handoff->word);
+      while (handoff->word.load () != 0)
+        {
+          futex_wait (&handoff->word, 1);
+        }
+    }
+}
+
+/**
+ * Helper function that times round trips between the calling thread and a
+ * peer pthread pinned to peer_cpu. The first round trip is not timed so
+ * that the thread creation is left out.
+ * @param kind OSM_SWITCH_CONDVAR or OSM_SWITCH_FUTEX
+ * @param iterations Number of round trips
+ * @param peer_cpu CPU of the peer thread
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double thread_rounds (osm_switch_kind kind, unsigned int iterations, int peer_cpu)
+{
+  Handoff handoff;
+  handoff.rounds = iterations + 1;
+  handoff.turn = 0;
+  handoff.word.store (0);
+  pthread_mutex_init (&handoff.mutex, nullptr);
+  pthread_cond_init (&handoff.cond, nullptr);
+
+  cpu_set_t mask;
+  CPU_ZERO (&mask);
+  CPU_SET (peer_cpu, &mask);
+  pthread_attr_t attr;
+  pthread_attr_init (&attr);
+  pthread_attr_setaffinity_np (&attr, sizeof (mask), &mask);
+  pthread_t peer;
+  void *(*peer_main) (void *) = kind == OSM_SWITCH_CONDVAR ? &condvar_peer : &futex_peer;
+  int created = pthread_create (&peer, &attr, peer_main, &handoff);
+  pthread_attr_destroy (&attr);
+  if (created != 0)
+    {
+      pthread_cond_destroy (&handoff.cond);
+      pthread_mutex_destroy (&handoff.mutex);
+      return FAIL;
+    }
+
+  void (*rounds) (Handoff *, unsigned int) = kind == OSM_SWITCH_CONDVAR ? &condvar_rounds
+                                                                         : &futex_rounds;
+  rounds (&handoff, 1);
+  uint64_t start = osm_region_begin ();
+  rounds (&handoff, iterations);
+  uint64_t end = osm_region_end ();
+  pthread_join (peer, nullptr);
+  pthread_cond_destroy (&handoff.cond);
+  pthread_mutex_destroy (&handoff.mutex);
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end);
+}
+
+/* ---------------------------- process handoff ----------------------------- */
+
+/**
+ * Helper function that times round trips of a single byte between the
+ * calling process and a child pinned to peer_cpu, over two pipes
+ * @param iterations Number of round trips
+ * @param peer_cpu CPU of the child process
+ * @return The elapsed time in Nano-seconds in case of success, -1 otherwise.
+ */
+static double process_rounds (unsigned int iterations, int peer_cpu)
+{
+  int to_child[2], to_parent[2];
+  if (pipe (to_child) == -1)
+    {
+      return FAIL;
+    }
+  if (pipe (to_parent) == -1)
+    {
+      close (to_child[0]);
+      close (to_child[1]);
+      return FAIL;
+    }
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      close (to_child[1]);
+      close (to_parent[0]);
+      osm_pin_thread (peer_cpu);
+      char byte;
+      while (read (to_child[0], &byte, 1) == 1 && write (to_parent[1], &byte, 1) == 1)
+        {}
+      _exit (0);
+    }
+  close (to_child[0]);
+  close (to_parent[1]);
+  double elapsed = FAIL;
+  if (pid != -1)
+    {
+      char byte = 0;
+      bool ok = write (to_child[1], &byte, 1) == 1 && read (to_parent[0], &byte, 1) == 1;
+      uint64_t start = osm_region_begin ();
+      for (unsigned int i = 0; ok && i < iterations; i++)
+        {
+          ok = write (to_child[1], &byte, 1) == 1 && read (to_parent[0], &byte, 1) == 1;
+        }
+      uint64_t end = osm_region_end ();
+      if (ok && start != 0 && end != 0)
+        {
+          elapsed = osm_timer_elapsed_ns (start, end);
+        }
+    }
+  close (to_child[1]);
+  close (to_parent[0]);
+  if (pid != -1)
+    {
+      waitpid (pid, nullptr, 0);
+    }
+  return elapsed;
+}
+
+/* --------------------------------- trial ---------------------------------- */
+
+/**
+ * Harness trial of a context switch path. The calling thread is pinned to
+ * the first allowed CPU for the duration of the trial.
+ * @param iterations Number of round trips
+ * @param arg Pointer to the SwitchTrial
+ * @return The time of a single round trip in Nano-seconds in case of
+ * success, -1 otherwise.
+ */
+static double switch_trial (unsigned int iterations, void *arg)
+{
+  SwitchTrial *trial = (SwitchTrial *) arg;
+  int cpu = osm_cpu_allowed (0);
+  int peer_cpu = osm_cpu_allowed (trial->placement == OSM_CROSS_CORE ? 1 : 0);
+  if (cpu == FAIL || peer_cpu == FAIL || osm_pin_thread (cpu) == FAIL)
+    {
+      return FAIL;
+    }
+  double elapsed;
+  switch (trial->kind)
+    {
+      case OSM_SWITCH_SIGJMP_MASK:
+        elapsed = sigjmp_rounds (iterations, 1);
+        break;
+      case OSM_SWITCH_SIGJMP_NOMASK:
+        elapsed = sigjmp_rounds (iterations, 0);
+        break;
+      case OSM_SWITCH_CONDVAR:
+      case OSM_SWITCH_FUTEX:
+        elapsed = thread_rounds (trial->kind, iterations, peer_cpu);
+        break;
+      case OSM_SWITCH_PIPE_PROCESS:
+        elapsed = process_rounds (iterations, peer_cpu);
+        break;
+      default:
+        elapsed = FAIL;
+    }
+  osm_pin_thread (ORIGINAL_MASK);
+  if (elapsed == FAIL)
+    {
+      return FAIL;
+    }
+  return elapsed / iterations;
+}
+
+const char *osm_switch_name (osm_switch_kind kind)
+{
+  if (kind < 0 || kind >= OSM_SWITCH_KIND_COUNT)
+    {
+      return nullptr;
+    }
+  return SWITCH_NAMES[kind];
+}
+
+int osm_switch_stats (osm_switch_kind kind, osm_placement placement,
+                      const osm_config *config, osm_results *results)
+{
+  if (kind < 0 || kind >= OSM_SWITCH_KIND_COUNT)
+    {
+      return FAIL;
+    }
+  if (placement == OSM_CROSS_CORE
+      && (kind == OSM_SWITCH_SIGJMP_MASK || kind == OSM_SWITCH_SIGJMP_NOMASK))
+    {
+      return FAIL;
+    }
+  SwitchTrial trial = {kind, placement};
+  if (osm_measure (&switch_trial, &trial, config, results) == FAIL)
+    {
+      return FAIL;
+    }
+  /* the counters are per iteration too, so both are scaled together */
+  osm_scale_results (results, 1.0 / SWITCHES_PER_ROUND_TRIP);
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "osm.h"
+#include "osm_timer.h"
+#include "osm_harness.h"
+#include "osm_counters.h"
+
+#define FAIL -1
+#define PIPE_BATCH 4096
+
+static const char *const PATH_NAMES[OSM_SYSCALL_PATH_COUNT] = {
+    "syscall_invalid", "getpid", "getppid",
+    "vdso_clock_gettime", "vdso_gettimeofday", "pipe_read"
+};
+
+/**
+ * Helper function that runs a kernel entry path that needs no setup
+ * @param path The kernel entry path
+ * @param iterations Number of iterations
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int run_path (osm_syscall_path path, unsigned int iterations)
+{
+  struct timespec ts{};
+  struct timeval tv{};
+  switch (path)
+    {
+      case OSM_SYSCALL_INVALID:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            OSM_NULLSYSCALL;
+          }
+        return 0;
+      case OSM_SYSCALL_GETPID:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            getpid ();
+          }
+        return 0;
+      case OSM_SYSCALL_GETPPID:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            getppid ();
+          }
+        return 0;
+      case OSM_VDSO_CLOCK_GETTIME:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            clock_gettime (CLOCK_MONOTONIC, &ts);
+          }
+        return 0;
+      case OSM_VDSO_GETTIMEOFDAY:
+        for (unsigned int i = 0; i < iterations; i++)
+          {
+            gettimeofday (&tv, nullptr);
+          }
+        return 0;
+      default:
+        return FAIL;
+    }
+}
+
+/**
+ * Helper function that times 1 byte reads of a pipe. The pipe is filled
+ * (untimed) in batches, so that every timed read finds data and goes through
+ * the whole read path without sleeping.
+ * @param iterations Number of reads
+ * @return The time of a single read in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double pipe_read_time (unsigned int iterations)
+{
+  int fds[2];
+  if (pipe (fds) == -1)
+    {
+      return FAIL;
+    }
+  static char buffer[PIPE_BATCH];
+  double total = 0;
+  unsigned int done = 0;
+  while (done < iterations)
+    {
+      unsigned int batch = iterations - done < PIPE_BATCH ? iterations - done : PIPE_BATCH;
+      if (write (fds[1], buffer, batch) != (ssize_t) batch)
+        {
+          total = FAIL;
+          break;
+        }
+      uint64_t start = osm_region_begin ();
+      for (unsigned int i = 0; i < batch; i++)
+        {
+          char byte;
+          if (read (fds[0], &byte, 1) != 1)
+            {
+              start = 0;
+              break;
+            }
+        }
+      uint64_t end = osm_region_end ();
+      if (start == 0 || end == 0)
+        {
+          total = FAIL;
+          break;
+        }
+      total += osm_timer_elapsed_ns (start, end);
+      done += batch;
+    }
+  close (fds[0]);
+  close (fds[1]);
+  return total == FAIL ? FAIL : total / iterations;
+}
+
+/**
+ * Harness trial of a kernel entry path
+ * @param iterations Number of iterations
+ * @param arg Pointer to the osm_syscall_path
+ * @return The time of a single call in Nano-seconds in case of success,
+ * -1 otherwise.
+ */
+static double syscall_trial (unsigned int iterations, void *arg)
+{
+  osm_syscall_path path = *(osm_syscall_path *) arg;
+  if (path == OSM_SYSCALL_PIPE_READ)
+    {
+      return pipe_read_time (iterations);
+    }
+  uint64_t start = osm_region_begin ();
+  if (run_path (path, iterations) == FAIL)
+    {
+      return FAIL;
+    }
+  uint64_t end = osm_region_end ();
+  if (start == 0 || end == 0)
+    {
+      return FAIL;
+    }
+  return osm_timer_elapsed_ns (start, end) / iterations;
+}
+
+const char *osm_syscall_path_name (osm_syscall_path path)
+{
+  if (path < 0 || path >= OSM_SYSCALL_PATH_COUNT)
+    {
+      return nullptr;
+    }
+  return PATH_NAMES[path];
+}
+
+int osm_syscall_path_stats (osm_syscall_path path, const osm_config *config,
+                            osm_results *results)
+{
+  if (path < 0 || path >= OSM_SYSCALL_PATH_COUNT)
+    {
+      return FAIL;
+    }
+  return osm_measure (&syscall_trial, &path, config, results);
+}
+
+int osm_syscall_suite (const osm_config *config,
+                       osm_results results[OSM_SYSCALL_PATH_COUNT])
+{
+  int ret = 0;
+  for (int path = 0; path < OSM_SYSCALL_PATH_COUNT; path++)
+    {
+      results[path] = osm_results{};
+      if (osm_syscall_path_stats ((osm_syscall_path) path, config, &results[path]) == FAIL)
+        {
+          ret = FAIL;
+        }
+    }
+  return ret;
+}
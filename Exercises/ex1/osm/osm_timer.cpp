@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <sys/time.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "osm_timer.h"
+
+#define SEC_TO_NANO 1000000000ULL
+#define MIK_TO_NANO 1000ULL
+#define CALIBRATION_NS 20000000ULL
+#define CALIBRATION_ROUNDS 5
+#define BRACKET_ATTEMPTS 8
+#define RDTSCP_BIT (1u << 27)
+#define INVARIANT_TSC_BIT (1u << 8)
+
+static osm_timer current_timer = OSM_TIMER_MONOTONIC_RAW;
+static double tsc_ticks_per_ns = -1;
+
+/**
+ * Reads CLOCK_MONOTONIC_RAW in nano-seconds
+ * @return The time in nano-seconds, 0 upon failure.
+ */
+static uint64_t read_monotonic_raw ()
+{
+  struct timespec ts{};
+  if (clock_gettime (CLOCK_MONOTONIC_RAW, &ts) == -1)
+    {
+      return 0;
+    }
+  return (uint64_t) ts.tv_sec * SEC_TO_NANO + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Reads gettimeofday in nano-seconds
+ * @return The time in nano-seconds, 0 upon failure.
+ */
+static uint64_t read_gettimeofday ()
+{
+  struct timeval tv{};
+  if (gettimeofday (&tv, nullptr) == -1)
+    {
+      return 0;
+    }
+  return (uint64_t) tv.tv_sec * SEC_TO_NANO + (uint64_t) tv.tv_usec * MIK_TO_NANO;
+}
+
+/**
+ * Reads the time stamp counter. rdtscp waits for all the previous
+ * instructions to retire, and the lfence keeps the following instructions
+ * from starting before the counter was read.
+ * @return The TSC value, 0 on architectures without a TSC.
+ */
+static inline uint64_t read_tsc ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t low, high, aux;
+  asm volatile("rdtscp\n\t"
+               "lfence"
+  : "=a" (low), "=d" (high), "=c" (aux)
+  :
+  : "memory");
+  return ((uint64_t) high << 32) | low;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Checks that the CPU has rdtscp and an invariant TSC (constant rate,
+ * not stopped in deep C-states)
+ * @return true if the TSC can be used as a timer, false otherwise.
+ */
+static bool tsc_supported ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid (0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & RDTSCP_BIT))
+    {
+      return false;
+    }
+  if (!__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & INVARIANT_TSC_BIT))
+    {
+      return false;
+    }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Reads the TSC between two reads of CLOCK_MONOTONIC_RAW, keeping the
+ * narrowest of a few brackets: a preemption between the reads widens the
+ * bracket instead of shifting the pair.
+ * @param ns the time at the middle of the bracket
+ * @param tsc the TSC value read inside the bracket
+ * @return 0 upon success, -1 otherwise.
+ */
+static int read_tsc_bracketed (uint64_t *ns, uint64_t *tsc)
+{
+  uint64_t narrowest = 0;
+  for (int attempt = 0; attempt < BRACKET_ATTEMPTS; attempt++)
+    {
+      uint64_t before = read_monotonic_raw ();
+      uint64_t ticks = read_tsc ();
+      uint64_t after = read_monotonic_raw ();
+      if (before == 0 || after < before)
+        {
+          return -1;
+        }
+      if (attempt == 0 || after - before < narrowest)
+        {
+          narrowest = after - before;
+          *ns = before + narrowest / 2;
+          *tsc = ticks;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Calibrates the TSC frequency by spinning against CLOCK_MONOTONIC_RAW,
+ * keeping the median of a few rounds, so that a round disturbed by a
+ * preemption does not bias the scale either way.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int calibrate_tsc ()
+{
+  double ratios[CALIBRATION_ROUNDS];
+  for (int round = 0; round < CALIBRATION_ROUNDS; round++)
+    {
+      uint64_t ns_start, tsc_start, ns_end, tsc_end;
+      if (read_tsc_bracketed (&ns_start, &tsc_start) == -1)
+        {
+          return -1;
+        }
+      uint64_t now = ns_start;
+      while (now != 0 && now - ns_start < CALIBRATION_NS)
+        {
+          now = read_monotonic_raw ();
+        }
+      if (now == 0 || read_tsc_bracketed (&ns_end, &tsc_end) == -1
+          || tsc_end <= tsc_start || ns_end <= ns_start)
+        {
+          return -1;
+        }
+      ratios[round] = (double) (tsc_end - tsc_start) / (double) (ns_end - ns_start);
+    }
+  std::sort (ratios, ratios + CALIBRATION_ROUNDS);
+  tsc_ticks_per_ns = ratios[CALIBRATION_ROUNDS / 2];
+  return 0;
+}
+
+int osm_set_timer (osm_timer timer)
+{
+  switch (timer)
+    {
+      case OSM_TIMER_GETTIMEOFDAY:
+      case OSM_TIMER_MONOTONIC_RAW:
+        break;
+      case OSM_TIMER_TSC:
+        if (!tsc_supported ())
+          {
+            return -1;
+          }
+        if (tsc_ticks_per_ns < 0 && calibrate_tsc () == -1)
+          {
+            return -1;
+          }
+        break;
+      default:
+        return -1;
+    }
+  current_timer = timer;
+  return 0;
+}
+
+osm_timer osm_get_timer ()
+{
+  return current_timer;
+}
+
+double osm_tsc_ticks_per_ns ()
+{
+  return tsc_ticks_per_ns;
+}
+
+uint64_t osm_timer_read ()
+{
+  switch (current_timer)
+    {
+      case OSM_TIMER_GETTIMEOFDAY:
+        return read_gettimeofday ();
+      case OSM_TIMER_TSC:
+        return read_tsc ();
+      default:
+        return read_monotonic_raw ();
+    }
+}
+
+double osm_timer_elapsed_ns (uint64_t start, uint64_t end)
+{
+  double elapsed = (double) (end - start);
+  if (current_timer == OSM_TIMER_TSC)
+    {
+      return elapsed / tsc_ticks_per_ns;
+    }
+  return elapsed;
+}
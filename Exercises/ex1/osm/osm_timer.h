@@ -0,0 +1,21 @@
+#ifndef _OSM_TIMER_H
+#define _OSM_TIMER_H
+
+#include <stdint.h>
+#include "osm.h"
+
+
+/* Reads the currently selected timing engine.
+   returns a raw timestamp in engine units (nano-seconds or TSC ticks),
+   and 0 upon failure.
+   */
+uint64_t osm_timer_read();
+
+
+/* Converts the difference of two osm_timer_read() timestamps
+   into nano-seconds.
+   */
+double osm_timer_elapsed_ns(uint64_t start, uint64_t end);
+
+
+#endif
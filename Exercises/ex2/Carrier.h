@@ -0,0 +1,48 @@
+#ifndef EX2_CARRIER_H
+#define EX2_CARRIER_H
+
+#include <pthread.h>
+#include <time.h>
+#include "Uthread.h"
+#include "SchedulingPolicy.h"
+
+/**
+ * The state of a kernel thread that runs user threads (a carrier). Every
+ * carrier has its own READY threads, ordered by its scheduling policy, and
+ * its own preemption timer;
+ * a carrier whose queue is empty takes threads from the back of the queues
+ * of the other carriers, and waits when there are none.
+ * Only the carrier itself changes its running thread, the rest is changed
+ * under the library lock.
+ */
+struct Carrier {
+
+    /**
+     * Constructor of a carrier without threads
+     * @param index position of the carrier among the carriers
+     * @param policy the READY threads, owned by the carrier
+     */
+    Carrier(int index, SchedulingPolicy *policy) :
+            ready_queue(policy), running_thread(nullptr), terminated_thread(nullptr), idle_context(nullptr), index(index),
+            kernel_thread(), timer(), timer_armed(false), preempting(false) {}
+
+    ~Carrier() {
+        delete ready_queue;
+    }
+
+    SchedulingPolicy *ready_queue;
+    Uthread *running_thread;
+    /* a thread that terminated, retired to the released threads once the carrier left its stack */
+    Uthread *terminated_thread;
+    /* saved stack pointer of the loop the carrier runs when it has no thread */
+    void *idle_context;
+    int index;
+    pthread_t kernel_thread;
+    timer_t timer;
+    /* false while the tickless mode stopped the timer */
+    bool timer_armed;
+    /* true while a more urgent thread takes the CPU from the running thread, see preempt_if_outranked */
+    bool preempting;
+};
+
+#endif //EX2_CARRIER_H
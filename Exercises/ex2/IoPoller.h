@@ -0,0 +1,278 @@
+#ifndef EX2_IO_POLLER_H
+#define EX2_IO_POLLER_H
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define IO_READ_EVENTS (EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLHUP | EPOLLERR)
+#define IO_WRITE_EVENTS (EPOLLOUT | EPOLLHUP | EPOLLERR)
+
+/**
+ * Class that tracks the descriptors the threads wait for, on an epoll
+ * instance. A descriptor is registered once, edge-triggered for both
+ * directions, and keeps the ids of the threads that wait to read it and to
+ * write it; an event hands out all the waiters of its direction. The ids
+ * may be stale (the thread woke up or terminated), so a woken id is only a
+ * hint and the thread checks the descriptor again. An eventfd in the same
+ * instance wakes up a carrier that blocks in wait.
+ * The poller is changed only under the library lock, except for wait and
+ * wake.
+ */
+class IoPoller {
+
+public:
+    /**
+     * Constructor of a closed poller
+     */
+    IoPoller() : epoll_fd(-1), wake_fd(-1) {}
+
+    /**
+     * Creates the epoll instance, if it was not created yet
+     * @return true on success, false upon failure (errno is set).
+     */
+    bool open() {
+        if (epoll_fd != -1) {
+            return true;
+        }
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) {
+            return false;
+        }
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wake_fd;
+        if (wake_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) == -1) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Closes the epoll instance and forgets all the descriptors
+     */
+    void close() {
+        if (wake_fd != -1) {
+            ::close(wake_fd);
+        }
+        if (epoll_fd != -1) {
+            ::close(epoll_fd);
+        }
+        epoll_fd = wake_fd = -1;
+        fds.clear();
+        deadlines.clear();
+    }
+
+    /**
+     * Makes the descriptor non-blocking, once per descriptor
+     * @param fd a non-negative descriptor
+     * @return true on success, false upon failure (errno is set).
+     */
+    bool make_nonblocking(int fd) {
+        Descriptor &descriptor = at(fd);
+        if (descriptor.nonblocking) {
+            return true;
+        }
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+            return false;
+        }
+        descriptor.nonblocking = true;
+        return true;
+    }
+
+    /**
+     * Adds a thread that waits for the descriptor, registering the descriptor on its first wait
+     * @param fd a non-negative descriptor
+     * @param tid the id of the thread
+     * @param events EPOLLIN, EPOLLOUT or both
+     * @return true on success, false upon failure (errno is set).
+     */
+    bool watch(int fd, int tid, uint32_t events) {
+        Descriptor &descriptor = at(fd);
+        if (!descriptor.registered) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP | EPOLLET;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+                return false;
+            }
+            descriptor.registered = true;
+        }
+        if (events & EPOLLIN) {
+            descriptor.readers.push_back(tid);
+        }
+        if (events & EPOLLOUT) {
+            descriptor.writers.push_back(tid);
+        }
+        return true;
+    }
+
+    /**
+     * Removes a thread of watch that did not get an event of the descriptor
+     * @param fd the descriptor
+     * @param tid the id of the thread
+     */
+    void unwatch(int fd, int tid) {
+        Descriptor &descriptor = at(fd);
+        remove(descriptor.readers, tid);
+        remove(descriptor.writers, tid);
+    }
+
+    /**
+     * Forgets the state of the descriptor, whose number may be reused from now on
+     * @param fd the descriptor
+     */
+    void forget(int fd) {
+        if (fd >= 0 && fd < (int) fds.size()) {
+            fds[fd] = Descriptor();
+        }
+    }
+
+    /**
+     * Adds a time after which a thread stops waiting
+     * @param nanoseconds time of the monotonic clock, see now
+     * @param tid the id of the thread
+     */
+    void add_deadline(long long nanoseconds, int tid) {
+        deadlines.insert(std::make_pair(nanoseconds, tid));
+    }
+
+    /**
+     * Removes a time of add_deadline, if it did not pass yet
+     * @param nanoseconds the time
+     * @param tid the id of the thread
+     */
+    void cancel_deadline(long long nanoseconds, int tid) {
+        auto range = deadlines.equal_range(nanoseconds);
+        for (auto deadline = range.first; deadline != range.second; ++deadline) {
+            if (deadline->second == tid) {
+                deadlines.erase(deadline);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @param extra_ms the longest time to wait anyway, -1 for no limit
+     * @return the milliseconds until the next deadline, at most extra_ms, -1 if there is no limit.
+     */
+    int timeout_ms(int extra_ms) const {
+        if (deadlines.empty()) {
+            return extra_ms;
+        }
+        long long left = (deadlines.begin()->first - now() + 999999) / 1000000;
+        int timeout = left < 0 ? 0 : (int) left;
+        return extra_ms != -1 && extra_ms < timeout ? extra_ms : timeout;
+    }
+
+    /**
+     * Waits for events, may be called without the library lock
+     * @param events the events
+     * @param max_events the size of events
+     * @param timeout milliseconds, 0 returns right away and -1 has no limit
+     * @return the number of events, 0 on timeout or failure.
+     */
+    int wait(struct epoll_event *events, int max_events, int timeout) {
+        int count = epoll_wait(epoll_fd, events, max_events, timeout);
+        return count < 0 ? 0 : count;
+    }
+
+    /**
+     * Makes a wait that blocks return, may be called without the library lock
+     */
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void) written;
+    }
+
+    /**
+     * Collects the ids of the threads that the events and the passed deadlines wake up
+     * @param events the events of wait
+     * @param count the number of events
+     * @param tids the ids are appended to it, possibly more than once
+     */
+    void ready(const struct epoll_event *events, int count, std::vector<int> &tids) {
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == wake_fd) {
+                uint64_t value;
+                ssize_t got = read(wake_fd, &value, sizeof(value));
+                (void) got;
+                continue;
+            }
+            Descriptor &descriptor = at(events[i].data.fd);
+            if (events[i].events & IO_READ_EVENTS) {
+                take(descriptor.readers, tids);
+            }
+            if (events[i].events & IO_WRITE_EVENTS) {
+                take(descriptor.writers, tids);
+            }
+        }
+        long long time = deadlines.empty() ? 0 : now();
+        while (!deadlines.empty() && deadlines.begin()->first <= time) {
+            tids.push_back(deadlines.begin()->second);
+            deadlines.erase(deadlines.begin());
+        }
+    }
+
+    /**
+     * @return the time of the monotonic clock in nanoseconds.
+     */
+    static long long now() {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (long long) time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+private:
+
+    /**
+     * The state of a descriptor
+     */
+    struct Descriptor {
+        Descriptor() : registered(false), nonblocking(false) {}
+
+        bool registered;
+        bool nonblocking;
+        std::vector<int> readers;
+        std::vector<int> writers;
+    };
+
+    Descriptor &at(int fd) {
+        if (fd >= (int) fds.size()) {
+            fds.resize(fd + 1);
+        }
+        return fds[fd];
+    }
+
+    static void take(std::vector<int> &waiters, std::vector<int> &tids) {
+        tids.insert(tids.end(), waiters.begin(), waiters.end());
+        waiters.clear();
+    }
+
+    static void remove(std::vector<int> &waiters, int tid) {
+        for (size_t i = 0; i < waiters.size(); i++) {
+            if (waiters[i] == tid) {
+                waiters[i] = waiters.back();
+                waiters.pop_back();
+                return;
+            }
+        }
+    }
+
+    int epoll_fd;
+    int wake_fd;
+    std::vector<Descriptor> fds;
+    /* the times the threads of uthread_poll stop waiting, by time */
+    std::multimap<long long, int> deadlines;
+};
+
+#endif //EX2_IO_POLLER_H
@@ -0,0 +1,427 @@
+#ifndef EX2_SCHEDULING_POLICY_H
+#define EX2_SCHEDULING_POLICY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "Uthread.h"
+
+#define FEEDBACK_BOOST_QUANTUMS 100 /* quantums of a carrier between two boosts of all its READY threads */
+
+/**
+ * Interface of the READY threads of a carrier, which decides the order the
+ * threads run in. Every carrier has a policy of its own, the state a policy
+ * keeps about a thread is kept in the thread, so a thread may move between
+ * the carriers.
+ */
+class SchedulingPolicy {
+
+public:
+    virtual ~SchedulingPolicy() {}
+
+    /**
+     * Adds a READY thread, a thread that is already in the policy keeps its place.
+     * @param thread the thread
+     */
+    virtual void push(Uthread *thread) = 0;
+
+    /**
+     * Removes the thread that runs next
+     * @return the thread, nullptr if there is none.
+     */
+    virtual Uthread *pop_next() = 0;
+
+    /**
+     * Removes a thread for another carrier whose policy has no thread
+     * @return the thread, nullptr if there is none.
+     */
+    virtual Uthread *steal() = 0;
+
+    /**
+     * Removes the thread, a thread that is not in the policy is ignored.
+     * @param thread the thread
+     */
+    virtual void erase(Uthread *thread) = 0;
+
+    virtual bool empty() const = 0;
+
+    /**
+     * Makes room for threads, so that adding them does not allocate memory inside the SIGVTALRM handler
+     * @param threads the number of threads the policy may hold
+     */
+    virtual void reserve(size_t) {}
+
+    /**
+     * Called when a thread stops running, before it is added again
+     * @param thread the thread
+     * @param quantum_over true if the quantum of the thread ended, false if it gave up the rest of it
+     * @param preempted true if a more urgent thread took the rest of the quantum, which the thread did not give up
+     */
+    virtual void stopped(Uthread *, bool, bool) {}
+
+    /**
+     * Called when a thread starts to run
+     * @param thread the thread
+     */
+    virtual void started(Uthread *) {}
+
+    /**
+     * Called when the quantum of the running thread ends
+     * @param thread the running thread
+     * @return true if the thread keeps running, without starting a new quantum.
+     */
+    virtual bool continues(const Uthread *) const {
+        return false;
+    }
+
+    /**
+     * @param thread the running thread
+     * @return true if a thread of the policy must run before thread, without waiting for its quantum to end.
+     */
+    virtual bool outranks(const Uthread *) const {
+        return false;
+    }
+};
+
+/**
+ * The round-robin policy: the threads run in the order they became READY.
+ */
+class RoundRobinPolicy : public SchedulingPolicy {
+
+public:
+    void push(Uthread *thread) override {
+        queue.push_back(thread);
+    }
+
+    Uthread *pop_next() override {
+        return queue.pop_front();
+    }
+
+    Uthread *steal() override {
+        return queue.pop_back();
+    }
+
+    void erase(Uthread *thread) override {
+        queue.erase(thread);
+    }
+
+    bool empty() const override {
+        return queue.empty();
+    }
+
+private:
+
+    ReadyQueue queue;
+};
+
+/**
+ * The fixed-priority policy: a queue per priority level, the most urgent
+ * level that has a thread runs first, and round-robin inside a level. A
+ * bitmap of the levels that have threads finds it with a find-first-set.
+ */
+class PriorityPolicy : public SchedulingPolicy {
+
+public:
+    /**
+     * Constructor of an empty policy
+     */
+    PriorityPolicy() : ready_levels(0) {}
+
+    void push(Uthread *thread) override {
+        int level = level_of(thread);
+        levels[level].push_back(thread);
+        ready_levels |= (uint32_t) 1 << level;
+    }
+
+    Uthread *pop_next() override {
+        if (ready_levels == 0) {
+            return nullptr;
+        }
+        return take(levels[__builtin_ctz(ready_levels)].front());
+    }
+
+    /**
+     * @return the most urgent thread that waits the least, so the order of the rest does not change.
+     */
+    Uthread *steal() override {
+        if (ready_levels == 0) {
+            return nullptr;
+        }
+        int level = __builtin_ctz(ready_levels);
+        Uthread *thread = levels[level].pop_back();
+        update_level(level);
+        return thread;
+    }
+
+    void erase(Uthread *thread) override {
+        take(thread);
+    }
+
+    bool empty() const override {
+        return ready_levels == 0;
+    }
+
+    bool outranks(const Uthread *thread) const override {
+        return ready_levels != 0 && __builtin_ctz(ready_levels) < level_of(thread);
+    }
+
+protected:
+
+    /**
+     * @param thread the thread
+     * @return the level of the thread, it does not change while the thread is queued.
+     */
+    virtual int level_of(const Uthread *thread) const {
+        return thread->get_priority();
+    }
+
+private:
+
+    Uthread *take(Uthread *thread) {
+        int level = level_of(thread);
+        levels[level].erase(thread);
+        update_level(level);
+        return thread;
+    }
+
+    void update_level(int level) {
+        if (levels[level].empty()) {
+            ready_levels &= ~((uint32_t) 1 << level);
+        }
+    }
+
+    ReadyQueue levels[UTHREAD_PRIORITY_LEVELS];
+    uint32_t ready_levels;
+};
+
+/**
+ * The multilevel feedback policy: a thread starts at the level of its
+ * priority, moves a level down every time it uses its whole quantum, and
+ * goes back to its priority when it gives up the CPU before the quantum
+ * ends, so threads that block early run before CPU hogs. A thread that a
+ * more urgent thread takes the CPU from keeps its level. Every
+ * FEEDBACK_BOOST_QUANTUMS quantums that end all the READY threads go back
+ * to their priority, so the hogs do not starve.
+ */
+class FeedbackPolicy : public PriorityPolicy {
+
+public:
+    /**
+     * Constructor of an empty policy
+     */
+    FeedbackPolicy() : quantums_to_boost(FEEDBACK_BOOST_QUANTUMS) {}
+
+    void stopped(Uthread *thread, bool quantum_over, bool preempted) override {
+        if (!quantum_over) {
+            if (!preempted) {
+                thread->set_feedback_level(thread->get_priority());
+            }
+            return;
+        }
+        if (thread->get_feedback_level() < UTHREAD_PRIORITY_LEVELS - 1) {
+            thread->set_feedback_level(thread->get_feedback_level() + 1);
+        }
+        if (--quantums_to_boost == 0) {
+            quantums_to_boost = FEEDBACK_BOOST_QUANTUMS;
+            boost_all();
+        }
+    }
+
+protected:
+
+    int level_of(const Uthread *thread) const override {
+        return thread->get_feedback_level();
+    }
+
+private:
+
+    /**
+     * Moves all the queued threads back to the level of their priority
+     */
+    void boost_all() {
+        ReadyQueue all;
+        Uthread *thread;
+        while ((thread = pop_next()) != nullptr) {
+            all.push_back(thread);
+        }
+        while ((thread = all.pop_front()) != nullptr) {
+            thread->set_feedback_level(thread->get_priority());
+            push(thread);
+        }
+    }
+
+    int quantums_to_boost;
+};
+
+/**
+ * The fair-share policy: every thread accumulates a virtual runtime, the
+ * time it ran on a monotonic clock divided by its weight, and the thread
+ * with the smallest virtual runtime runs next, so threads get CPU time in
+ * proportion to their weights. The threads are kept in a binary min-heap
+ * ordered by virtual runtime, like SleepQueue, whose room is reserved when
+ * the threads are created so that the SIGVTALRM handler never allocates.
+ * A thread runs at least granularity_ns before a quantum that ends takes it
+ * off the CPU, and a thread that becomes READY starts no more than
+ * granularity_ns behind the least virtual runtime, so a thread that slept
+ * for long does not hold the CPU until it caught up.
+ */
+class FairPolicy : public SchedulingPolicy {
+
+public:
+    /**
+     * Constructor of an empty policy
+     */
+    FairPolicy() : min_vruntime(0) {}
+
+    void push(Uthread *thread) override {
+        if (thread->fair_index >= 0) {
+            return;
+        }
+        if (thread->get_vruntime() < min_vruntime - granularity_ns) {
+            thread->set_vruntime(min_vruntime - granularity_ns);
+        }
+        heap.push_back(thread);
+        sift_up(heap.size() - 1);
+    }
+
+    Uthread *pop_next() override {
+        if (heap.empty()) {
+            return nullptr;
+        }
+        Uthread *thread = heap.front();
+        erase(thread);
+        if (thread->get_vruntime() > min_vruntime) {
+            min_vruntime = thread->get_vruntime();
+        }
+        return thread;
+    }
+
+    /**
+     * @return the thread of the largest virtual runtime, which would run last here (one of the leaves of the heap).
+     */
+    Uthread *steal() override {
+        if (heap.empty()) {
+            return nullptr;
+        }
+        Uthread *thread = heap.back();
+        for (size_t index = heap.size() / 2; index < heap.size(); index++) {
+            if (before(thread, heap[index])) {
+                thread = heap[index];
+            }
+        }
+        erase(thread);
+        return thread;
+    }
+
+    void erase(Uthread *thread) override {
+        if (thread->fair_index < 0) {
+            return;
+        }
+        size_t index = thread->fair_index;
+        Uthread *last = heap.back();
+        heap.pop_back();
+        thread->fair_index = -1;
+        if (last != thread) {
+            place(index, last);
+            sift_up(index);
+            sift_down(last->fair_index);
+        }
+    }
+
+    bool empty() const override {
+        return heap.empty();
+    }
+
+    /**
+     * Grows the heap geometrically, so that spawning n threads copies it O(log n) times and not n times
+     * @param threads the number of threads the policy may hold
+     */
+    void reserve(size_t threads) override {
+        if (threads > heap.capacity()) {
+            heap.reserve(threads > 2 * heap.capacity() ? threads : 2 * heap.capacity());
+        }
+    }
+
+    void started(Uthread *thread) override {
+        thread->set_run_start(now());
+    }
+
+    void stopped(Uthread *thread, bool, bool) override {
+        thread->set_vruntime(current_vruntime(thread));
+    }
+
+    bool continues(const Uthread *thread) const override {
+        return now() - thread->get_run_start() < granularity_ns;
+    }
+
+    bool outranks(const Uthread *thread) const override {
+        return !heap.empty() && current_vruntime(thread) - heap.front()->get_vruntime() > granularity_ns;
+    }
+
+    /* the least time a thread runs, see uthread_set_min_granularity */
+    static long long granularity_ns;
+
+private:
+
+    /**
+     * @return true if a runs before b: by virtual runtime, and by tid between threads of the same virtual runtime.
+     */
+    static bool before(const Uthread *a, const Uthread *b) {
+        return a->get_vruntime() < b->get_vruntime()
+               || (a->get_vruntime() == b->get_vruntime() && a->get_tid() < b->get_tid());
+    }
+
+    void place(size_t index, Uthread *thread) {
+        heap[index] = thread;
+        thread->fair_index = (int) index;
+    }
+
+    void sift_up(size_t index) {
+        Uthread *thread = heap[index];
+        while (index > 0 && before(thread, heap[(index - 1) / 2])) {
+            place(index, heap[(index - 1) / 2]);
+            index = (index - 1) / 2;
+        }
+        place(index, thread);
+    }
+
+    void sift_down(size_t index) {
+        Uthread *thread = heap[index];
+        size_t child;
+        while ((child = 2 * index + 1) < heap.size()) {
+            if (child + 1 < heap.size() && before(heap[child + 1], heap[child])) {
+                child++;
+            }
+            if (!before(heap[child], thread)) {
+                break;
+            }
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, thread);
+    }
+
+    /**
+     * @return the time of the monotonic clock in nanoseconds.
+     */
+    static long long now() {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (long long) time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    /**
+     * @param thread a running thread
+     * @return the virtual runtime of the thread, including the time it has run since it started.
+     */
+    static long long current_vruntime(const Uthread *thread) {
+        long long ran = now() - thread->get_run_start();
+        return thread->get_vruntime() + ran * UTHREAD_DEFAULT_WEIGHT / thread->get_weight();
+    }
+
+    std::vector<Uthread *> heap;
+    /* only grows, the threads that become READY are placed relative to it */
+    long long min_vruntime;
+};
+
+#endif //EX2_SCHEDULING_POLICY_H
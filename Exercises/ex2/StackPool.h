@@ -0,0 +1,114 @@
+#ifndef EX2_STACK_POOL_H
+#define EX2_STACK_POOL_H
+
+#include <map>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_CACHED_STACKS 1024 /* stacks kept for reuse, over all the sizes */
+#define GUARD_PAGES 1
+
+/**
+ * Class that allocates the stacks of the threads. Every stack is a mapping
+ * of its own whose lowest page is inaccessible, so an overflow faults
+ * instead of corrupting a neighbour. Released stacks are kept on a free
+ * list per size and handed out again, so spawning and terminating threads
+ * does not map memory every time. The free lists are linked through the
+ * top word of the stacks themselves, and the list of a size is created when
+ * a stack of the size is acquired, so releasing a stack never allocates.
+ */
+class StackPool {
+
+public:
+    /**
+     * Constructor of an empty pool
+     */
+    StackPool() : page_size((size_t) sysconf(_SC_PAGESIZE)), cached(0) {}
+
+    /**
+     * @param bytes requested stack size
+     * @return bytes rounded up to whole pages.
+     */
+    size_t round_size(size_t bytes) const {
+        return (bytes + page_size - 1) / page_size * page_size;
+    }
+
+    /**
+     * Allocates a stack, from the free list when possible
+     * @param bytes size of the stack, a multiple of the page size
+     * @return the lowest address of the stack, nullptr upon failure.
+     */
+    char *acquire(size_t bytes) {
+        char *&stacks = free_stacks[bytes];
+        if (stacks != nullptr) {
+            char *stack = stacks;
+            stacks = next_of(stack, bytes);
+            cached--;
+            return stack;
+        }
+        size_t guard = GUARD_PAGES * page_size;
+        void *base = mmap(nullptr, bytes + guard, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (base == MAP_FAILED) {
+            return nullptr;
+        }
+        if (mprotect(base, guard, PROT_NONE) == -1) {
+            munmap(base, bytes + guard);
+            return nullptr;
+        }
+        return (char *) base + guard;
+    }
+
+    /**
+     * Gives back a stack of acquire, it is kept for reuse unless the free
+     * lists are full
+     * @param stack the stack
+     * @param bytes size of the stack
+     */
+    void release(char *stack, size_t bytes) {
+        auto sized = free_stacks.find(bytes);
+        if (cached < MAX_CACHED_STACKS && sized != free_stacks.end()) {
+            next_of(stack, bytes) = sized->second;
+            sized->second = stack;
+            cached++;
+            return;
+        }
+        unmap(stack, bytes);
+    }
+
+    /**
+     * Unmaps all the stacks of the free lists
+     */
+    void clear() {
+        for (auto &sized : free_stacks) {
+            while (sized.second != nullptr) {
+                char *stack = sized.second;
+                sized.second = next_of(stack, sized.first);
+                unmap(stack, sized.first);
+            }
+        }
+        free_stacks.clear();
+        cached = 0;
+    }
+
+private:
+
+    /**
+     * @return the link of a stack of the free lists to the next one, in the top word of the stack.
+     */
+    static char *&next_of(char *stack, size_t bytes) {
+        return *(char **) (stack + bytes - sizeof(char *));
+    }
+
+    void unmap(char *stack, size_t bytes) {
+        size_t guard = GUARD_PAGES * page_size;
+        munmap(stack - guard, bytes + guard);
+    }
+
+    size_t page_size;
+    int cached;
+    /* the first free stack of every size, nullptr when there is none */
+    std::map<size_t, char *> free_stacks;
+};
+
+#endif //EX2_STACK_POOL_H
@@ -0,0 +1,95 @@
+#ifndef EX2_SYNC_H
+#define EX2_SYNC_H
+
+#include <vector>
+#include "Uthread.h"
+
+/*
+ * The synchronization primitives of the threads. The threads that wait for
+ * a primitive are parked in a queue of the primitive (linked through the
+ * threads like the READY threads, a WAITING thread is in no other queue),
+ * and whoever releases the primitive hands it to the first of them
+ * directly, so a woken thread never competes for it again.
+ * The primitives are changed only inside the library.
+ */
+
+/**
+ * A mutex, owned by the thread that locked it until the thread unlocks it
+ */
+struct uthread_mutex {
+
+    uthread_mutex() : owner(nullptr) {}
+
+    Uthread *owner;
+    ReadyQueue waiters;
+};
+
+/**
+ * A condition variable, its waiters wait for the mutex again once signalled
+ */
+struct uthread_cond {
+
+    uthread_cond() : mutex(nullptr) {}
+
+    /* the mutex of the waiters, while there are such */
+    uthread_mutex *mutex;
+    ReadyQueue waiters;
+};
+
+/**
+ * A counting semaphore
+ */
+struct uthread_sem {
+
+    explicit uthread_sem(int value) : value(value) {}
+
+    int value;
+    ReadyQueue waiters;
+};
+
+/**
+ * A barrier that releases its waiters every count arrivals
+ */
+struct uthread_barrier {
+
+    explicit uthread_barrier(int count) : count(count), arrived(0) {}
+
+    int count;
+    int arrived;
+    ReadyQueue waiters;
+};
+
+/**
+ * A bounded channel of pointers, with any number of senders and receivers.
+ * The buffer is a ring; a sender that finds it full waits with its item
+ * in the thread, and a receiver that finds it empty waits for an item to
+ * be put in the thread.
+ */
+struct uthread_channel {
+
+    explicit uthread_channel(int capacity) : items(capacity), head(0), size(0) {}
+
+    bool full() const {
+        return size == (int) items.size();
+    }
+
+    void push(void *item) {
+        items[(head + size) % items.size()] = item;
+        size++;
+    }
+
+    void *pop() {
+        void *item = items[head];
+        head = (head + 1) % items.size();
+        size--;
+        return item;
+    }
+
+    std::vector<void *> items;
+    int head;
+    int size;
+    ReadyQueue senders;
+    ReadyQueue receivers;
+};
+
+#endif //EX2_SYNC_H
@@ -0,0 +1,132 @@
+#ifndef EX2_TID_BITMAP_H
+#define EX2_TID_BITMAP_H
+
+#include <stdint.h>
+#include <vector>
+
+#define BITS_PER_WORD 64
+#define MIN_TID_CAPACITY 64
+
+/**
+ * Class that allocates thread ids, always the smallest free one. The free
+ * ids are bits of a hierarchical bitmap: a bit of an upper level is set
+ * when its word of the level below has a free id, so finding the smallest
+ * free id is a find-first-set per level, and the ids grow on demand.
+ */
+class TidBitmap {
+
+public:
+    /**
+     * Constructor of an allocator without ids
+     */
+    TidBitmap() : capacity(0) {}
+
+    /**
+     * Allocates the smallest free id
+     * @param limit ids must be below limit
+     * @return the id if such exists, otherwise -1.
+     */
+    int acquire(int limit) {
+        int tid = smallest_free();
+        while (tid == -1 && capacity < limit) {
+            grow();
+            tid = smallest_free();
+        }
+        if (tid == -1 || tid >= limit) {
+            return -1;
+        }
+        set_free(tid, false);
+        return tid;
+    }
+
+    /**
+     * Frees an id allocated by acquire
+     * @param tid the id
+     */
+    void release(int tid) {
+        set_free(tid, true);
+    }
+
+    /**
+     * @return the largest allocated id, -1 if there is none.
+     */
+    int largest_used() const {
+        if (levels.empty()) {
+            return -1;
+        }
+        const std::vector<uint64_t> &bottom = levels.front();
+        for (int word = (int) bottom.size() - 1; word >= 0; word--) {
+            if (~bottom[word] != 0) {
+                return word * BITS_PER_WORD + BITS_PER_WORD - 1 - __builtin_clzll(~bottom[word]);
+            }
+        }
+        return -1;
+    }
+
+private:
+
+    /**
+     * @return the smallest free id, -1 if all the ids are in use.
+     */
+    int smallest_free() const {
+        if (levels.empty() || levels.back()[0] == 0) {
+            return -1;
+        }
+        int index = 0;
+        for (int level = (int) levels.size() - 1; level >= 0; level--) {
+            index = index * BITS_PER_WORD + __builtin_ctzll(levels[level][index]);
+        }
+        return index;
+    }
+
+    /**
+     * Marks an id free or in use, the upper levels change only when a word
+     * becomes empty or stops being empty
+     * @param tid the id
+     * @param free true to free, false to use
+     */
+    void set_free(int tid, bool free) {
+        int index = tid;
+        for (std::vector<uint64_t> &level : levels) {
+            uint64_t &word = level[index / BITS_PER_WORD];
+            uint64_t bit = (uint64_t) 1 << (index % BITS_PER_WORD);
+            bool was_empty = word == 0;
+            word = free ? word | bit : word & ~bit;
+            if ((word == 0) == was_empty) {
+                return;
+            }
+            index /= BITS_PER_WORD;
+        }
+    }
+
+    /**
+     * Doubles the number of ids, the new ids are free
+     */
+    void grow() {
+        int old_capacity = capacity;
+        capacity = capacity == 0 ? MIN_TID_CAPACITY : 2 * capacity;
+        std::vector<uint64_t> bottom = levels.empty() ? std::vector<uint64_t>() : levels.front();
+        bottom.resize(capacity / BITS_PER_WORD, 0);
+        for (int word = old_capacity / BITS_PER_WORD; word < capacity / BITS_PER_WORD; word++) {
+            bottom[word] = ~(uint64_t) 0;
+        }
+        levels.clear();
+        levels.push_back(bottom);
+        while (levels.back().size() > 1) {
+            const std::vector<uint64_t> &below = levels.back();
+            std::vector<uint64_t> above((below.size() + BITS_PER_WORD - 1) / BITS_PER_WORD, 0);
+            for (size_t word = 0; word < below.size(); word++) {
+                if (below[word] != 0) {
+                    above[word / BITS_PER_WORD] |= (uint64_t) 1 << (word % BITS_PER_WORD);
+                }
+            }
+            levels.push_back(above);
+        }
+    }
+
+    int capacity;
+    /* levels[0] has a bit per id, set when the id is free */
+    std::vector<std::vector<uint64_t>> levels;
+};
+
+#endif //EX2_TID_BITMAP_H
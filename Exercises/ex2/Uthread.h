@@ -8,15 +8,18 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <stdbool.h>
+#include <vector>
 
 typedef unsigned long address_t;
 #define JB_SP 6
 #define JB_PC 7
 
 enum state {
-    READY, RUNNING, BLOCKED, SLEEP
+    READY, RUNNING, BLOCKED, SLEEP, TERMINATED, WAITING
 };
 
+class ReadyQueue;
+
 /**
  * Class That represents a single thread object
  */
@@ -27,14 +30,24 @@ public:
      * Constructor
      * @param tid id of thread
      * @param entry_point thread entry point
+     * @param stack lowest address of the stack of the thread, nullptr for the main thread that runs on the stack
+     * of the process
+     * @param stack_size size of the stack
      */
-    Uthread(int tid, thread_entry_point entry_point) :
-            tid(tid), quantum(0), uthread_state(READY), is_sleeping(false), num_q_to_sleep(0) {
-        address_t sp = (address_t) uthread_stack + STACK_SIZE - sizeof(address_t);
-        address_t pc = (address_t) entry_point;
+    Uthread(int tid, thread_entry_point entry_point, char *stack = nullptr, size_t stack_size = 0) :
+            tid(tid), quantum(0), uthread_stack(stack), stack_size(stack_size), uthread_state(READY),
+            is_sleeping(false), wake_quantum(0), ready_prev(nullptr), ready_next(nullptr), in_ready(false),
+            sleep_index(-1), entry_point(entry_point), context(nullptr), carrier(0),
+            priority(UTHREAD_DEFAULT_PRIORITY), feedback_level(UTHREAD_DEFAULT_PRIORITY),
+            weight(UTHREAD_DEFAULT_WEIGHT), vruntime(0), run_start(0), fair_index(-1), wait_queue(nullptr),
+            transfer(nullptr), arg_entry_point(nullptr), argument(nullptr), exit_value(nullptr), detached(true) {
         sigsetjmp(env, 1);
-        (env->__jmpbuf)[JB_SP] = translate_address(sp);
-        (env->__jmpbuf)[JB_PC] = translate_address(pc);
+        if (stack != nullptr) {
+            address_t sp = (address_t) uthread_stack + stack_size - sizeof(address_t);
+            address_t pc = (address_t) entry_point;
+            (env->__jmpbuf)[JB_SP] = translate_address(sp);
+            (env->__jmpbuf)[JB_PC] = translate_address(pc);
+        }
         sigemptyset(&env->__saved_mask);
     }
 
@@ -52,11 +65,8 @@ public:
     void increase_quantum() {
         Uthread::quantum++;
     }
-    void decrease_num_q_to_sleep() {
-        Uthread::num_q_to_sleep--;
-    }
-    void set_num_q_to_sleep(int num) {
-        num_q_to_sleep = num;
+    void set_wake_quantum(int quantum_num) {
+        wake_quantum = quantum_num;
     }
 
     void set_uthread_state(state uthreadState) {
@@ -71,8 +81,16 @@ public:
         return quantum;
     }
 
-    int get_num_q_to_sleep() const {
-        return num_q_to_sleep;
+    char *get_stack() const {
+        return uthread_stack;
+    }
+
+    size_t get_stack_size() const {
+        return stack_size;
+    }
+
+    int get_wake_quantum() const {
+        return wake_quantum;
     }
 
     state get_uthread_state() const {
@@ -83,6 +101,142 @@ public:
         return env;
     }
 
+    thread_entry_point get_entry_point() const {
+        return entry_point;
+    }
+
+    /**
+     * @return where the fast switch saves the stack pointer of the thread.
+     */
+    void **get_context() {
+        return &context;
+    }
+
+    void set_context(void *stack_pointer) {
+        context = stack_pointer;
+    }
+
+    /**
+     * @return the carrier the thread runs on, or whose queue it is in.
+     */
+    int get_carrier() const {
+        return carrier;
+    }
+
+    void set_carrier(int carrier_index) {
+        carrier = carrier_index;
+    }
+
+    int get_priority() const {
+        return priority;
+    }
+
+    /**
+     * Sets the priority, and moves the thread to the level of its priority in the multilevel feedback policy
+     * @param thread_priority the priority
+     */
+    void set_priority(int thread_priority) {
+        priority = thread_priority;
+        feedback_level = thread_priority;
+    }
+
+    int get_feedback_level() const {
+        return feedback_level;
+    }
+
+    void set_feedback_level(int level) {
+        feedback_level = level;
+    }
+
+    int get_weight() const {
+        return weight;
+    }
+
+    void set_weight(int thread_weight) {
+        weight = thread_weight;
+    }
+
+    /**
+     * @return the virtual runtime of the fair-share policy in nanoseconds, up to the last time the thread stopped.
+     */
+    long long get_vruntime() const {
+        return vruntime;
+    }
+
+    void set_vruntime(long long virtual_runtime) {
+        vruntime = virtual_runtime;
+    }
+
+    long long get_run_start() const {
+        return run_start;
+    }
+
+    void set_run_start(long long start) {
+        run_start = start;
+    }
+
+    /**
+     * @return the queue of the synchronization primitive the thread waits for, nullptr if it waits for none.
+     */
+    ReadyQueue *get_wait_queue() const {
+        return wait_queue;
+    }
+
+    void set_wait_queue(ReadyQueue *queue) {
+        wait_queue = queue;
+    }
+
+    /**
+     * @return the item the thread passes through a channel, or the result of the thread it joined.
+     */
+    void *get_transfer() const {
+        return transfer;
+    }
+
+    void set_transfer(void *item) {
+        transfer = item;
+    }
+
+    /**
+     * @return the entry point of a thread of uthread_spawn_arg, nullptr for the other threads.
+     */
+    thread_arg_entry_point get_arg_entry_point() const {
+        return arg_entry_point;
+    }
+
+    void *get_argument() const {
+        return argument;
+    }
+
+    /**
+     * Makes the thread run arg_entry_point(arg) instead of its entry point
+     * @param entry the entry point that takes the argument
+     * @param arg the argument
+     */
+    void set_arg_entry_point(thread_arg_entry_point entry, void *arg) {
+        arg_entry_point = entry;
+        argument = arg;
+    }
+
+    void *get_exit_value() const {
+        return exit_value;
+    }
+
+    void set_exit_value(void *value) {
+        exit_value = value;
+    }
+
+    /**
+     * @return true if the thread is released as soon as it terminates, false if it is kept for uthread_join.
+     */
+    bool is_detached() const {
+        return detached;
+    }
+
+    void set_detached(bool is_detached) {
+        detached = is_detached;
+    }
+
     void set_is_sleeping(bool is_sleeping) {
         Uthread::is_sleeping = is_sleeping;
     }
@@ -94,13 +248,251 @@ public:
 
 private:
 
+    friend class ReadyQueue;
+    friend class SleepQueue;
+    friend class FairPolicy;
+
     int tid;
     int quantum;
-    char uthread_stack[STACK_SIZE];
+    char *uthread_stack;
+    size_t stack_size;
     state uthread_state;
     sigjmp_buf env;
     bool is_sleeping;
-    int num_q_to_sleep;
+    int wake_quantum;
+    /* links of the ready queue, only used by ReadyQueue */
+    Uthread *ready_prev;
+    Uthread *ready_next;
+    bool in_ready;
+    /* position in the sleep queue, only used by SleepQueue */
+    int sleep_index;
+    thread_entry_point entry_point;
+    /* saved stack pointer of the fast switch */
+    void *context;
+    int carrier;
+    int priority;
+    /* the level of the multilevel feedback policy, moves away from the priority with the use of the CPU */
+    int feedback_level;
+    int weight;
+    long long vruntime;
+    /* when the thread last started to run, on the monotonic clock */
+    long long run_start;
+    /* position in the heap of FairPolicy, only used by FairPolicy */
+    int fair_index;
+    ReadyQueue *wait_queue;
+    void *transfer;
+    thread_arg_entry_point arg_entry_point;
+    void *argument;
+    /* the result of the thread for uthread_join, nullptr unless it exited with one */
+    void *exit_value;
+    bool detached;
+};
+
+/**
+ * Class that represents the queue of READY threads. The queue is linked
+ * through the threads themselves, so pushing, popping and erasing a thread
+ * take constant time whatever the number of threads.
+ */
+class ReadyQueue {
+
+public:
+    /**
+     * Constructor of an empty queue
+     */
+    ReadyQueue() : head(nullptr), tail(nullptr), count(0) {}
+
+    /**
+     * Adds the thread to the end of the queue, a thread that is already in
+     * the queue keeps its place.
+     * @param thread the thread
+     */
+    void push_back(Uthread *thread) {
+        if (thread->in_ready) {
+            return;
+        }
+        thread->ready_prev = tail;
+        thread->ready_next = nullptr;
+        if (tail != nullptr) {
+            tail->ready_next = thread;
+        } else {
+            head = thread;
+        }
+        tail = thread;
+        thread->in_ready = true;
+        count++;
+    }
+
+    /**
+     * Removes the first thread of the queue
+     * @return the thread, nullptr if the queue is empty.
+     */
+    Uthread *pop_front() {
+        Uthread *thread = head;
+        if (thread != nullptr) {
+            erase(thread);
+        }
+        return thread;
+    }
+
+    /**
+     * Removes the last thread of the queue
+     * @return the thread, nullptr if the queue is empty.
+     */
+    Uthread *pop_back() {
+        Uthread *thread = tail;
+        if (thread != nullptr) {
+            erase(thread);
+        }
+        return thread;
+    }
+
+    /**
+     * Removes the thread from the queue, a thread that is not in the queue
+     * is ignored.
+     * @param thread the thread
+     */
+    void erase(Uthread *thread) {
+        if (!thread->in_ready) {
+            return;
+        }
+        if (thread->ready_prev != nullptr) {
+            thread->ready_prev->ready_next = thread->ready_next;
+        } else {
+            head = thread->ready_next;
+        }
+        if (thread->ready_next != nullptr) {
+            thread->ready_next->ready_prev = thread->ready_prev;
+        } else {
+            tail = thread->ready_prev;
+        }
+        thread->ready_prev = nullptr;
+        thread->ready_next = nullptr;
+        thread->in_ready = false;
+        count--;
+    }
+
+    Uthread *front() const {
+        return head;
+    }
+
+    bool empty() const {
+        return head == nullptr;
+    }
+
+    int size() const {
+        return count;
+    }
+
+private:
+
+    Uthread *head;
+    Uthread *tail;
+    int count;
+};
+
+/**
+ * Class that represents the sleeping threads, a binary min-heap ordered by
+ * the quantum the threads wake up in (and by tid between threads that wake
+ * up together), so that a new quantum only looks at the threads that wake
+ * up. Every thread knows its position, so it can be erased in logarithmic
+ * time.
+ */
+class SleepQueue {
+
+public:
+    /**
+     * Adds the thread, according to its wake up quantum
+     * @param thread the thread, not in the queue
+     */
+    void push(Uthread *thread) {
+        heap.push_back(thread);
+        sift_up(heap.size() - 1);
+    }
+
+    /**
+     * @return the thread that wakes up first, nullptr if the queue is empty.
+     */
+    Uthread *top() const {
+        return heap.empty() ? nullptr : heap.front();
+    }
+
+    /**
+     * Removes the thread that wakes up first
+     * @return the thread, nullptr if the queue is empty.
+     */
+    Uthread *pop() {
+        Uthread *thread = top();
+        if (thread != nullptr) {
+            erase(thread);
+        }
+        return thread;
+    }
+
+    /**
+     * Removes the thread from the queue, a thread that is not in the queue
+     * is ignored.
+     * @param thread the thread
+     */
+    void erase(Uthread *thread) {
+        if (thread->sleep_index < 0) {
+            return;
+        }
+        size_t index = thread->sleep_index;
+        Uthread *last = heap.back();
+        heap.pop_back();
+        thread->sleep_index = -1;
+        if (last != thread) {
+            place(index, last);
+            sift_up(index);
+            sift_down(last->sleep_index);
+        }
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+private:
+
+    /**
+     * @return true if a wakes up before b, false otherwise.
+     */
+    static bool earlier(const Uthread *a, const Uthread *b) {
+        return a->wake_quantum < b->wake_quantum
+               || (a->wake_quantum == b->wake_quantum && a->tid < b->tid);
+    }
+
+    void place(size_t index, Uthread *thread) {
+        heap[index] = thread;
+        thread->sleep_index = (int) index;
+    }
+
+    void sift_up(size_t index) {
+        Uthread *thread = heap[index];
+        while (index > 0 && earlier(thread, heap[(index - 1) / 2])) {
+            place(index, heap[(index - 1) / 2]);
+            index = (index - 1) / 2;
+        }
+        place(index, thread);
+    }
+
+    void sift_down(size_t index) {
+        Uthread *thread = heap[index];
+        size_t child;
+        while ((child = 2 * index + 1) < heap.size()) {
+            if (child + 1 < heap.size() && earlier(heap[child + 1], heap[child])) {
+                child++;
+            }
+            if (!earlier(heap[child], thread)) {
+                break;
+            }
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, thread);
+    }
+
+    std::vector<Uthread *> heap;
 };
 
 #endif //EX2_UTHREAD_H
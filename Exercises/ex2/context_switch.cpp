@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include "context_switch.h"
+
+#if defined(__x86_64__)
+
+#define MXCSR_DEFAULT 0x1f80 /* all the SSE exceptions masked, round to nearest */
+#define FPU_CW_DEFAULT 0x037f /* all the x87 exceptions masked, double extended precision */
+#define SAVED_REGISTERS 6 /* rbp, rbx, r12 - r15 */
+
+/* The frame of a switched out thread, from its stack pointer up: the SSE and x87 control words, r15, r14, r13,
+   r12, rbx, rbp, and the return address into the thread. */
+asm(".text\n"
+    ".globl uthread_context_switch\n"
+    ".type uthread_context_switch, @function\n"
+    "uthread_context_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size uthread_context_switch, .-uthread_context_switch\n");
+
+/**
+ * Prepares a new stack so that the first switch to it calls start
+ * @param stack lowest address of the stack
+ * @param stack_size size of the stack, a multiple of 16 bytes
+ * @param start function the thread starts with, it must not return
+ * @return the stack pointer to give to uthread_context_switch.
+ */
+void *uthread_context_init(char *stack, size_t stack_size, void (*start)(void))
+{
+    // the return address sits at a multiple of 16, so that start sees the stack as after a call
+    uint64_t *frame = (uint64_t *) (stack + stack_size) - 2;
+    frame[0] = (uint64_t) start;
+    for (int i = 1; i <= SAVED_REGISTERS; i++)
+        {
+            frame[-i] = 0;
+        }
+    uint64_t *control = frame - SAVED_REGISTERS - 1;
+    *control = (uint64_t) MXCSR_DEFAULT | ((uint64_t) FPU_CW_DEFAULT << 32);
+    return control;
+}
+
+/**
+ * @param variable address of a thread_local variable of the calling kernel thread
+ * @return the offset of the variable from the thread pointer, the same in every kernel thread.
+ */
+ptrdiff_t uthread_tls_offset(const void *variable)
+{
+    // the first word of the thread control block points to the block itself
+    char *thread_pointer;
+    asm("movq %%fs:0, %0" : "=r" (thread_pointer));
+    return (const char *) variable - thread_pointer;
+}
+
+#else
+
+/**
+ * The fast switch is not implemented on this architecture, see UTHREAD_HAS_FAST_SWITCH
+ */
+extern "C" void uthread_context_switch(void **, void *)
+{
+}
+
+void *uthread_context_init(char *, size_t, void (*)(void))
+{
+    return nullptr;
+}
+
+ptrdiff_t uthread_tls_offset(const void *)
+{
+    return 0;
+}
+
+#endif
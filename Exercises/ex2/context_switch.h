@@ -0,0 +1,71 @@
+#ifndef EX2_CONTEXT_SWITCH_H
+#define EX2_CONTEXT_SWITCH_H
+
+#include <stddef.h>
+
+/**
+ * Saves the callee-saved registers of the calling thread on its stack, stores its stack pointer in *save_sp,
+ * and continues the thread whose stack pointer is load_sp. Returns when a switch loads *save_sp again.
+ * Only the registers that a function call must preserve are switched; the signal mask is left as it is.
+ * @param save_sp output, the saved stack pointer of the calling thread
+ * @param load_sp saved stack pointer of the thread to continue
+ */
+extern "C" void uthread_context_switch(void **save_sp, void *load_sp);
+
+/**
+ * Prepares a new stack so that the first switch to it calls start
+ * @param stack lowest address of the stack
+ * @param stack_size size of the stack, a multiple of 16 bytes
+ * @param start function the thread starts with, it must not return
+ * @return the stack pointer to give to uthread_context_switch.
+ */
+void *uthread_context_init(char *stack, size_t stack_size, void (*start)(void));
+
+/**
+ * @param variable address of a thread_local variable of the calling kernel thread
+ * @return the offset of the variable from the thread pointer, the same in every kernel thread.
+ */
+ptrdiff_t uthread_tls_offset(const void *variable);
+
+/* true where uthread_context_switch is implemented (x86-64 only) */
+#if defined(__x86_64__)
+#define UTHREAD_HAS_FAST_SWITCH true
+
+/**
+ * Reads the word at offset from the thread pointer of the kernel thread that runs the call, with a single
+ * instruction, so a thread switched by a signal handler cannot read the word of the kernel thread it left.
+ * @param offset offset of uthread_tls_offset
+ * @return the word.
+ */
+static inline long uthread_tls_load(ptrdiff_t offset)
+{
+    long value;
+    asm volatile("movq %%fs:(%1), %0" : "=r" (value) : "r" (offset) : "memory");
+    return value;
+}
+
+/**
+ * Writes the word at offset from the thread pointer of the kernel thread that runs the call, with a single
+ * instruction, see uthread_tls_load
+ * @param offset offset of uthread_tls_offset
+ * @param value the word
+ */
+static inline void uthread_tls_store(ptrdiff_t offset, long value)
+{
+    asm volatile("movq %1, %%fs:(%0)" : : "r" (offset), "r" (value) : "memory");
+}
+#else
+#define UTHREAD_HAS_FAST_SWITCH false
+
+/* only the fast switch uses the thread pointer words, see UTHREAD_HAS_FAST_SWITCH */
+static inline long uthread_tls_load(ptrdiff_t)
+{
+    return 0;
+}
+
+static inline void uthread_tls_store(ptrdiff_t, long)
+{
+}
+#endif
+
+#endif //EX2_CONTEXT_SWITCH_H
@@ -1,13 +1,28 @@
 #include "uthreads.h"
 #include <queue>
+#include <map>
 #include <cstdlib>
-#include <vector>
 #include <signal.h>
 #include <sys/time.h>
+#include <atomic>
 #include <csetjmp>
 #include <thread>
 #include <iostream>
+#include <cerrno>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include "Uthread.h"
+#include "Carrier.h"
+#include "SchedulingPolicy.h"
+#include "Sync.h"
+#include "IoPoller.h"
+#include "TidBitmap.h"
+#include "StackPool.h"
+#include "context_switch.h"
 
 static const char *const SLEEP_ERROR = "thread library error: trying to send to "
                                        "sleep the main thread.";
@@ -23,16 +38,94 @@ static const char *const TERMINATE_ERROR = "thread library error: trying to term
                                            "valid thread with non-valid id.";
 static const char *const BLOCK_ERROR = "thread library error: trying to block thread with non-valid id.";
 static const char *const RESUME_ERROR = "thread library error: trying to resume a thread with non-valid id.";
+static const char *const MAX_THREADS_LIMIT_ERROR = "thread library error: the maximal number of threads "
+                                                   "must be positive and above the ids in use.";
+static const char *const STACK_SIZE_ERROR = "thread library error: stack size must be positive integer.";
+static const char *const SYS_ERROR_STACK = "system error: unable to allocate a thread stack.";
+static const char *const FAST_SWITCH_ERROR = "thread library error: the fast switch is not supported on "
+                                             "this architecture.";
+static const char *const CARRIERS_ERROR = "thread library error: the number of carriers must be positive integer.";
+static const char *const SYS_ERROR_CARRIER = "system error: unable to start a carrier.";
+static const char *const POLICY_ERROR = "thread library error: only one scheduling policy can be chosen.";
+static const char *const PRIORITY_ERROR = "thread library error: priority out of range.";
+static const char *const WEIGHT_ERROR = "thread library error: the weight must be positive and of an existing thread.";
+static const char *const GRANULARITY_ERROR = "thread library error: the granularity must not be negative.";
+static const char *const MUTEX_ERROR = "thread library error: the mutex is not locked by the calling thread, or "
+                                       "is locked by it already.";
+static const char *const SYNC_BUSY_ERROR = "thread library error: destroying a synchronization primitive in use.";
+static const char *const SYNC_VALUE_ERROR = "thread library error: non-valid value of a synchronization primitive.";
+static const char *const COND_ERROR = "thread library error: waiting on a condition variable with another mutex.";
+static const char *const DEADLOCK_ERROR = "thread library error: all the threads wait for synchronization "
+                                          "primitives.";
+static const char *const JOIN_ERROR = "thread library error: trying to join the calling thread, or a detached "
+                                      "thread or a thread with non-valid id.";
+static const char *const DETACH_ERROR = "thread library error: trying to detach a thread with non-valid id.";
 static const char *const QUANTUM_ERROR = "thread library error: trying to get quantums of thread with non-valid id.";
 static const int SECONDS = 1000000;
+static const int NANOSECONDS_PER_USEC = 1000;
+static const size_t IDLE_STACK_SIZE = 64 * 1024;
+/* the SIGVTALRM frame, the handler and the scheduler run on the stack of the interrupted thread, on the fast path
+   even without signals, and with several carriers a timer tick and an interrupt of another carrier may stack
+   their signal frames */
+static const size_t MIN_SCHEDULER_STACK_SIZE = 32 * 1024;
+static const int IO_EVENTS = 64;
 
-std::vector<Uthread *> ready_vector;
-Uthread *uthreads_array[MAX_THREAD_NUM];
+long long FairPolicy::granularity_ns = (long long) UTHREAD_DEFAULT_GRANULARITY * NANOSECONDS_PER_USEC;
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+SleepQueue sleep_queue;
+std::vector<Uthread *> uthreads_array;
+TidBitmap tid_bitmap;
+int max_threads = MAX_THREAD_NUM;
+StackPool stack_pool;
+size_t default_stack_size = STACK_SIZE;
+/* the threads that terminated on their own stacks and whose carriers left the stacks, released by the next
+   library call that does not run inside the SIGVTALRM handler, since releasing them frees memory */
+ReadyQueue terminated_threads;
+
+/* the fast path switches with uthread_context_switch and never masks SIGVTALRM, a quantum that ends while
+   preemption is disabled (inside the library) is handled when the library is left */
+bool fast_switch = false;
+/* the tickless mode disarms the timer while the running thread is the only one that could run, the cooperative
+   mode has no timer and no signals at all, threads switch only in library calls */
+bool tickless = false;
+bool cooperative = false;
+/* the preemption flags of the carrier, accessed only through uthread_tls_load and uthread_tls_store since a
+   thread may continue on another carrier after any instruction that runs with preemption enabled */
+thread_local volatile long preemption_disabled = 0;
+thread_local volatile long preemption_pending = 0;
+ptrdiff_t disabled_offset;
+ptrdiff_t pending_offset;
+
+/* the kernel threads that run the threads, with several carriers the library state is shared under
+   library_lock, which is held whenever a carrier runs library code */
+std::vector<Carrier *> carriers;
+int num_carriers = 1;
+thread_local Carrier *this_carrier = nullptr;
+ptrdiff_t carrier_offset;
+std::atomic_flag library_lock = ATOMIC_FLAG_INIT;
+/* changes whenever work is added while carriers wait, the waiting carriers sleep on it */
+std::atomic<int> work_sequence (0);
+int idle_carriers = 0;
+
+/* the threads that wait for descriptors are parked in io_waiters, the carriers poll the descriptors once a
+   quantum and when they run out of threads, and one idle carrier at a time (io_polling) blocks in the poller */
+IoPoller io_poller;
+ReadyQueue io_waiters;
+bool io_polling = false;
+struct epoll_event io_events[IO_EVENTS];
+std::vector<int> io_ready;
+
+/* the threads that wait for a thread to terminate, by its id, and the results of the joinable threads that
+   terminated before a thread joined them, whose ids stay in use until then */
+std::map<int, ReadyQueue> join_queues;
+std::map<int, void *> exit_values;
 
-bool index_free[MAX_THREAD_NUM] = {true};
 int uthread_quantum_usecs = -1;
 int num_of_uthread = 0;
-Uthread *running_thread;
 int quantums;
 struct itimerval timer;
 
@@ -42,14 +135,107 @@ int min_free_id ();
 
 void delete_all_thread ();
 
+void release_terminated ();
+
+void retire_terminated ();
+
+int spawn_thread (thread_entry_point entry_point, size_t stack_size, int priority,
+                  thread_arg_entry_point arg_entry_point, void *arg);
+
+void arg_thread_start ();
+
+void wake_joiners (Uthread *thread);
+
+bool invalid_priority (int priority);
+
+void preempt_if_outranked ();
+
+SchedulingPolicy *new_policy (int flags);
+
+void park (ReadyQueue *wait_queue);
+
+Uthread *unpark (ReadyQueue *wait_queue);
+
+void unpark_thread (Uthread *thread);
+
+int prepare_fd (int fd, bool nonblocking);
+
+bool retry_io (int fd, uint32_t events);
+
+int wait_fd (int fd, uint32_t events);
+
+void park_io ();
+
+int poll_io (int timeout);
+
+void wake_io_threads (const struct epoll_event *events, int count);
+
+int io_timeout_ms ();
+
+ssize_t leave_io (ssize_t result);
+
+int current_errno ();
+
+void set_current_errno (int error);
+
+void hand_mutex (uthread_mutex *mutex, Uthread *thread);
+
 void erase_from_ready (int tid);
 
 bool invalid_tid (int tid);
 
 void set_clock ();
 
+void stop_clock ();
+
+void write_clock (int usecs);
+
+void update_clock (Carrier *carrier);
+
 void block_unblock (int sig);
 
+void preempt (int sig);
+
+void thread_start ();
+
+void make_ready (Uthread *thread);
+
+Carrier *current_carrier ();
+
+bool disable_preemption ();
+
+void lock_library ();
+
+void enable_preemption ();
+
+void stop_if_descheduled ();
+
+void push_ready (Uthread *thread);
+
+void reserve_ready ();
+
+Uthread *next_ready (Carrier *carrier);
+
+void run_thread (Carrier *carrier, Uthread *thread);
+
+bool runs_on_carrier (Uthread *thread);
+
+void interrupt_carrier (Uthread *thread);
+
+void wake_idle_carrier ();
+
+void start_carriers ();
+
+void create_carrier_timer (Carrier *carrier);
+
+void *carrier_main (void *arg);
+
+void carrier_idle ();
+
+Uthread *idle_quantum (Carrier *carrier);
+
+void update_sleeping_threads ();
+
 /**
  * @brief initializes the thread library.
  *
@@ -57,384 +243,2404 @@ void block_unblock (int sig);
  * exactly once.
  * The input to the function is the length of a quantums in micro-seconds.
  * It is an error to call this function with non-positive quantum_usecs.
+ * The SIGVTALRM handler and the scheduler run on the stack of the interrupted thread, so the stacks of the threads
+ * are at least 32 KiB, whatever STACK_SIZE or uthread_set_stack_size ask for.
  *
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_init (int quantum_usecs)
 {
-    block_unblock (SIG_SETMASK);
-    quantums = 1;
+    return uthread_init_with_flags (quantum_usecs, 0);
+}
+
+/**
+ * @brief initializes the thread library like uthread_init, with the options of flags (UTHREAD_FAST_SWITCH).
+ *
+ * With UTHREAD_FAST_SWITCH the threads are switched by saving and loading only the registers a function call
+ * preserves, and the library defers the end of a quantum while it runs instead of masking SIGVTALRM, so
+ * neither a switch nor a library call needs a system call for the signal mask.
+ * With UTHREAD_TICKLESS the timer is stopped while no other thread is READY and no thread sleeps, so a single
+ * runnable thread is never interrupted, and the quantum it runs in lasts until another thread becomes READY.
+ * With UTHREAD_COOPERATIVE no timer is set and no signal is used: a thread runs until it yields, blocks, sleeps
+ * or terminates, and only these calls start a new quantum. The stacks of the threads then keep the size they are
+ * given, unless UTHREAD_FAST_SWITCH is set as well (see uthread_init).
+ * With UTHREAD_PRIORITY the READY thread of the most urgent priority runs next, round-robin between threads of the
+ * same priority, and a thread that becomes READY with a more urgent priority than the running thread of the calling
+ * carrier runs right away. UTHREAD_FEEDBACK orders the threads the same way by a level that starts at the priority
+ * of the thread, moves one level less urgent every time the thread uses its whole quantum, and goes back to the
+ * priority when the thread gives up the CPU before its quantum ends (and every 100 quantums that end on the
+ * carrier, so that no thread starves). A thread that a more urgent thread takes the CPU from keeps its level.
+ * With UTHREAD_FAIR the READY thread that has run the least time (on a monotonic clock) divided by its weight runs
+ * next, so the threads of a carrier get CPU time in proportion to their weights (see uthread_set_weight). A quantum
+ * that ends before the running thread ran the minimal granularity (see uthread_set_min_granularity) does not stop
+ * it, and a thread that becomes READY runs right away if the running thread of the calling carrier is ahead of it
+ * by more than the granularity.
+ * It is an error to ask for more than one of UTHREAD_PRIORITY, UTHREAD_FEEDBACK and UTHREAD_FAIR.
+ * It is an error to ask for an option that is not supported on this machine.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_with_flags (int quantum_usecs, int flags)
+{
+    return uthread_init_carriers (quantum_usecs, flags, 1);
+}
+
+/**
+ * @brief initializes the thread library like uthread_init_with_flags, running the threads on num_carriers kernel
+ * threads (carriers) instead of one.
+ *
+ * Every carrier has its own READY threads list and its own quantum timer, measured in the CPU time of the carrier.
+ * Spawned and resumed threads are added to the list of the calling carrier, and a carrier whose list is empty takes
+ * threads from the end of the lists of the other carriers. Blocking or terminating a thread that runs on another
+ * carrier interrupts that carrier, so the thread stops running right away.
+ * With more than one carrier UTHREAD_FAST_SWITCH is implied, and a thread may continue on another kernel thread
+ * after every switch, so it must not keep thread-local data (such as errno) across a library call.
+ * The stacks of the threads are then at least 32 KiB, since a thread may take several SIGVTALRM frames at once.
+ * The total number of quantums counts the quantums of all the carriers. The library needs -pthread and -lrt.
+ * It is an error to call this function with non-positive num_carriers.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_carriers (int quantum_usecs, int flags, int carriers_count)
+{
+    if (carriers_count <= 0)
+        {
+            std::cerr << CARRIERS_ERROR << std::endl;
+            return -1;
+        }
+    if (carriers_count > 1)
+        {
+            flags |= UTHREAD_FAST_SWITCH;
+        }
+    if ((flags & UTHREAD_FAST_SWITCH) && !UTHREAD_HAS_FAST_SWITCH)
+        {
+            std::cerr << FAST_SWITCH_ERROR << std::endl;
+            return -1;
+        }
+    if (__builtin_popcount (flags & (UTHREAD_PRIORITY | UTHREAD_FEEDBACK | UTHREAD_FAIR)) > 1)
+        {
+            std::cerr << POLICY_ERROR << std::endl;
+            return -1;
+        }
     if (quantum_usecs <= 0)
         {
             std::cerr << NEGATIVE_QUANTOM_ERROR << std::endl;
             return -1;
         }
-    running_thread = new Uthread (0, nullptr);
-    running_thread->set_uthread_state (RUNNING);
-    running_thread->increase_quantum ();
-    uthreads_array[0] = running_thread;
+    fast_switch = (flags & UTHREAD_FAST_SWITCH) != 0;
+    tickless = (flags & UTHREAD_TICKLESS) != 0;
+    cooperative = (flags & UTHREAD_COOPERATIVE) != 0;
+    if (fast_switch)
+        {
+            disabled_offset = uthread_tls_offset ((const void *) &preemption_disabled);
+            pending_offset = uthread_tls_offset ((const void *) &preemption_pending);
+            carrier_offset = uthread_tls_offset (&this_carrier);
+        }
+    num_carriers = carriers_count;
+    for (int i = 0; i < num_carriers; i++)
+        {
+            carriers.push_back (new Carrier (i, new_policy (flags)));
+        }
+    this_carrier = carriers.front ();
+    Uthread *main_thread = new Uthread (0, nullptr);
+    run_thread (this_carrier, main_thread);
+    block_unblock (SIG_SETMASK);
+    quantums = 1;
+    tid_bitmap.acquire (max_threads);
+    uthreads_array.push_back (main_thread);
+    reserve_ready ();
 
     uthread_quantum_usecs = quantum_usecs;
     struct sigaction sa = {nullptr};
     sa.sa_handler = &scheduler;
-    if (sigaction (SIGVTALRM, &sa, nullptr) < 0)
+    if (fast_switch)
+        {
+            // the handler may switch threads without returning, so the signal must not stay masked
+            sa.sa_handler = &preempt;
+            sa.sa_flags = SA_NODEFER;
+        }
+    if (!cooperative && sigaction (SIGVTALRM, &sa, nullptr) < 0)
         {
             std::cerr << SYS_ERROR_HANDLER << std::endl;
             delete_all_thread();
             exit (1);
         }
-    set_clock ();
-    for (int i = 0; i < MAX_THREAD_NUM; i++)
+    if (num_carriers > 1)
+        {
+            start_carriers ();
+        }
+    if (tickless)
         {
-            index_free[i] = true;
+            update_clock (this_carrier);
+        }
+    else
+        {
+            set_clock ();
         }
-    index_free[0] = false;
     block_unblock (SIG_UNBLOCK);
     return 0;
 }
 
 /**
- * Helper function that block and unblock the SIGVTALRM signal according to the sig parameter.
- * @param sig SIG_SETMASK or SIG_UNBLOCK
+ * Helper function that creates the READY threads of a carrier, ordered by
+ * the scheduling policy of the flags of uthread_init_with_flags
+ * @param flags the flags
+ * @return the policy.
  */
-void block_unblock (int sig)
+SchedulingPolicy *new_policy (int flags)
 {
-    sigset_t set;
-    sigemptyset(&set);
-    sigaddset(&set, SIGVTALRM);
-    if (sigprocmask (sig, &set, nullptr) == -1)
+    if (flags & UTHREAD_PRIORITY)
         {
-            std::cerr << SYS_ERROR_SET_MASK << std::endl;
-            delete_all_thread();
-            exit (1);
+            return new PriorityPolicy ();
+        }
+    if (flags & UTHREAD_FEEDBACK)
+        {
+            return new FeedbackPolicy ();
+        }
+    if (flags & UTHREAD_FAIR)
+        {
+            return new FairPolicy ();
         }
+    return new RoundRobinPolicy ();
 }
 
 /**
- * Helper function that sets virtual clock
+ * Helper function that starts the carriers other than the calling kernel thread, which becomes the first carrier.
+ * The first carrier waits for work on a stack of its own, since the main thread keeps the stack of the process.
  */
-void set_clock ()
+void start_carriers ()
 {
+    Carrier *first = carriers.front ();
+    first->kernel_thread = pthread_self ();
+    create_carrier_timer (first);
+    char *idle_stack = stack_pool.acquire (IDLE_STACK_SIZE);
+    if (idle_stack == nullptr)
+        {
+            std::cerr << SYS_ERROR_STACK << std::endl;
+            delete_all_thread ();
+            exit (1);
+        }
+    first->idle_context = uthread_context_init (idle_stack, IDLE_STACK_SIZE, &carrier_idle);
+    for (int i = 1; i < num_carriers; i++)
+        {
+            if (pthread_create (&carriers[i]->kernel_thread, nullptr, &carrier_main, carriers[i]) != 0)
+                {
+                    std::cerr << SYS_ERROR_CARRIER << std::endl;
+                    delete_all_thread ();
+                    exit (1);
+                }
+        }
+}
 
-    int seconds = uthread_quantum_usecs / SECONDS;
-    int useconds = uthread_quantum_usecs - seconds * SECONDS;
-    timer.it_value.tv_sec = seconds;
-    timer.it_value.tv_usec = useconds;
-    timer.it_interval.tv_sec = seconds;
-    timer.it_interval.tv_usec = useconds;
-    if (setitimer (ITIMER_VIRTUAL, &timer, nullptr) == -1)
+/**
+ * Helper function that creates the quantum timer of the carrier, which counts the CPU time of the calling kernel
+ * thread and sends SIGVTALRM to it.
+ * @param carrier the carrier of the calling kernel thread
+ */
+void create_carrier_timer (Carrier *carrier)
+{
+    if (cooperative)
         {
-            std::cerr << SYS_ERROR_VIRTUAL_TIME << std::endl;
-            delete_all_thread();
+            return;
+        }
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGVTALRM;
+    event.sigev_notify_thread_id = (pid_t) syscall (SYS_gettid);
+    if (timer_create (CLOCK_THREAD_CPUTIME_ID, &event, &carrier->timer) == -1)
+        {
+            std::cerr << SYS_ERROR_CARRIER << std::endl;
+            delete_all_thread ();
             exit (1);
         }
 }
 
 /**
- * Helper function that updates the num of quantums for each
- * sleeping thread
+ * Entry point of the kernel threads of the carriers
+ * @param arg the carrier
  */
-void update_sleeping_threads ()
+void *carrier_main (void *arg)
+{
+    this_carrier = (Carrier *) arg;
+    disable_preemption ();
+    create_carrier_timer (this_carrier);
+    carrier_idle ();
+    return nullptr;
+}
+
+/**
+ * The loop a carrier runs when it has no thread: it runs the next READY
+ * thread, and waits for work when there is none. It is entered and
+ * continued with preemption disabled and the library lock held.
+ */
+void carrier_idle ()
 {
-    for (int i = 0; i < MAX_THREAD_NUM; i++)
+    while (true)
         {
-            if (!index_free[i])
+            Carrier *carrier = current_carrier ();
+            retire_terminated ();
+            Uthread *thread = next_ready (carrier);
+            if (thread != nullptr)
+                {
+                    quantums++;
+                    run_thread (carrier, thread);
+                    // the quantum starts now, not when the timer of the idle carrier last fired
+                    uthread_tls_store (pending_offset, 0);
+                    set_clock ();
+                    update_clock (carrier);
+                    uthread_context_switch (&carrier->idle_context, *thread->get_context ());
+                    continue;
+                }
+            if (!io_waiters.empty () && !io_polling)
                 {
-                    if (uthreads_array[i]->get_is_sleeping ())
+                    // this carrier waits for the descriptors, and the other idle carriers for work
+                    struct epoll_event events[IO_EVENTS];
+                    int timeout = io_timeout_ms ();
+                    io_polling = true;
+                    idle_carriers++;
+                    library_lock.clear (std::memory_order_release);
+                    int count = io_poller.wait (events, IO_EVENTS, timeout);
+                    lock_library ();
+                    idle_carriers--;
+                    io_polling = false;
+                    wake_io_threads (events, count);
+                    if (count == 0 && !sleep_queue.empty ())
                         {
-                            uthreads_array[i]->decrease_num_q_to_sleep ();
-                            if (uthreads_array[i]->get_num_q_to_sleep () == 0)
-                                {
-                                    uthreads_array[i]->set_is_sleeping (false);
-                                    if (uthreads_array[i]->get_uthread_state () != BLOCKED)
-                                        {
-                                            uthread_resume (i);
-                                        }
-                                }
+                            quantums++;
+                            update_sleeping_threads ();
                         }
+                    continue;
+                }
+            // the sleeping threads count quantums, which pass in real time while all the carriers wait
+            struct timespec quantum;
+            quantum.tv_sec = uthread_quantum_usecs / SECONDS;
+            quantum.tv_nsec = (long) (uthread_quantum_usecs % SECONDS) * NANOSECONDS_PER_USEC;
+            struct timespec *timeout = sleep_queue.empty () ? nullptr : &quantum;
+            int sequence = work_sequence.load ();
+            idle_carriers++;
+            library_lock.clear (std::memory_order_release);
+            long waited = syscall (SYS_futex, &work_sequence, FUTEX_WAIT_PRIVATE, sequence, timeout, nullptr, 0);
+            bool timed_out = waited == -1 && errno == ETIMEDOUT;
+            lock_library ();
+            idle_carriers--;
+            if (timed_out)
+                {
+                    quantums++;
+                    update_sleeping_threads ();
                 }
         }
 }
 
 /**
- * Function that manages the current thread switch,
- * receives SIGVTALRM
+ * Helper function that returns the carrier that runs the calling code, it
+ * does not change while preemption is disabled.
+ * @return the carrier.
  */
-void scheduler (int)
+Carrier *current_carrier ()
 {
-    block_unblock (SIG_SETMASK);
-    quantums++;
-    update_sleeping_threads ();
-    if (running_thread != nullptr)
+    if (num_carriers == 1)
         {
-            if (sigsetjmp (running_thread->getEnv (), 1) == 1)
-                {
-                    return;
-                }
-            if (running_thread->get_uthread_state () != BLOCKED && running_thread->get_uthread_state () != SLEEP)
-                {
-                    running_thread->set_uthread_state (READY);
-                    ready_vector.push_back (running_thread);
-                }
+            return carriers.front ();
         }
-    running_thread = ready_vector.front ();
-    ready_vector.erase (ready_vector.begin ());
-    running_thread->set_uthread_state (RUNNING);
-    running_thread->increase_quantum ();
-    block_unblock (SIG_UNBLOCK);
-    siglongjmp (running_thread->getEnv (), 1);
+    return (Carrier *) uthread_tls_load (carrier_offset);
 }
 
 /**
- * @brief Creates a new thread, whose entry point is the function entry_point with the signature
- * void entry_point(void).
+ * @brief Sets the maximal number of concurrent threads (including the main thread), the default is
+ * MAX_THREAD_NUM.
  *
- * The thread is added to the end of the READY threads list.
- * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
- * Each thread should be allocated with a stack of size STACK_SIZE bytes.
+ * The thread table grows on demand up to the limit. It is an error to set a limit that is not positive or that is
+ * not above the ID of an existing thread.
+ * Every thread stack takes two memory mappings (the stack and its guard page), so more than about
+ * vm.max_map_count / 2 threads need that system limit raised.
  *
- * @return On success, return the ID of the created thread. On failure, return -1.
+ * @return On success, return 0. On failure, return -1.
 */
-int uthread_spawn (thread_entry_point entry_point)
+int uthread_set_max_threads (int max_thread_num)
 {
     block_unblock (SIG_SETMASK);
-    if (entry_point == nullptr)
-        {
-            std::cerr << NULL_SPAWN_ERROR << std::endl;
-            block_unblock (SIG_UNBLOCK);
-            return -1;
-        }
-    int free_tid = min_free_id ();
-    if (free_tid == -1)
+    if (max_thread_num <= 0 || max_thread_num <= tid_bitmap.largest_used ())
         {
-            std::cerr << MAX_THREADS_ERROR << std::endl;
+            std::cerr << MAX_THREADS_LIMIT_ERROR << std::endl;
             block_unblock (SIG_UNBLOCK);
             return -1;
         }
-    Uthread *new_thread = new Uthread (free_tid, entry_point);
-    int tid = new_thread->get_tid ();
-    uthreads_array[tid] = new_thread;
-    ready_vector.push_back (new_thread);
-    num_of_uthread++;
+    max_threads = max_thread_num;
     block_unblock (SIG_UNBLOCK);
-    return tid;
+    return 0;
 }
 
 /**
- * Helper function tha finds and returns the minimal free thread id.
- * @return the free id if such exists, otherwise -1.
+ * Helper function that block and unblock the SIGVTALRM signal according to the sig parameter.
+ * On the fast path the signal is not masked, preemption is disabled and enabled instead, and a quantum that ended
+ * in between starts when it is enabled. The cooperative mode of a single carrier has nothing to block.
+ * @param sig SIG_SETMASK or SIG_UNBLOCK
  */
-int min_free_id ()
+void block_unblock (int sig)
 {
-    for (int i = 1; i < MAX_THREAD_NUM; ++i)
+    if (cooperative && num_carriers == 1)
         {
-            if (index_free[i])
+            return;
+        }
+    if (fast_switch)
+        {
+            if (sig == SIG_UNBLOCK)
+                {
+                    enable_preemption ();
+                }
+            else if (disable_preemption ())
                 {
-                    index_free[i] = false;
-                    return i;
+                    stop_if_descheduled ();
                 }
+            return;
+        }
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGVTALRM);
+    if (sigprocmask (sig, &set, nullptr) == -1)
+        {
+            std::cerr << SYS_ERROR_SET_MASK << std::endl;
+            delete_all_thread();
+            exit (1);
         }
-    return -1;
 }
 
 /**
- * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
- *
- * All the resources allocated by the library for this thread should be released. If no thread with ID tid exists it
- * is considered an error. Terminating the main thread (tid == 0) will result in the termination of the entire
- * process using exit(0) (after releasing the assigned library memory).
- *
- * @return The function returns 0 if the thread was successfully terminated and -1 otherwise. If a thread terminates
- * itself or the main thread is terminated, the function does not return.
-*/
-int uthread_terminate (int tid)
+ * Helper function that disables preemption on the fast path, and takes the
+ * library lock when there are several carriers.
+ * @return true if preemption was enabled, false if it was already disabled.
+ */
+bool disable_preemption ()
 {
-    block_unblock (SIG_SETMASK);
-    if (tid == 0)
-        {
-            delete_all_thread ();
-            exit (0);
-        }
-    if (invalid_tid (tid))
+    if (uthread_tls_load (disabled_offset))
         {
-            std::cerr << TERMINATE_ERROR << std::endl;
-            block_unblock (SIG_UNBLOCK);
-            return -1;
+            return false;
         }
-    int running_thread_tid = running_thread->get_tid ();
-    if (running_thread_tid == tid)
+    uthread_tls_store (disabled_offset, 1);
+    if (num_carriers > 1)
         {
-            running_thread = nullptr;
-            set_clock ();
-            scheduler (SIGVTALRM);
+            lock_library ();
         }
-    erase_from_ready (tid);
-    delete (uthreads_array[tid]);
-    uthreads_array[tid] = nullptr;
-    index_free[tid] = true;
-    num_of_uthread--;
-    block_unblock (SIG_UNBLOCK);
-    return 0;
+    return true;
 }
 
 /**
- * Helper function that erases the given id thread from list of ready
- * threads.
- * @param tid thread id.
+ * Helper function that takes the library lock, spinning since it is only
+ * held for the short library calls and switches.
  */
-void erase_from_ready (int tid)
+void lock_library ()
 {
-
-    for (long unsigned int i = 0; i < ready_vector.size (); ++i)
+    while (library_lock.test_and_set (std::memory_order_acquire))
         {
-            if (ready_vector.at (i)->get_tid () == tid)
-                {
-                    ready_vector.erase (ready_vector.begin () + i);
-                }
+#if defined(__x86_64__)
+            __builtin_ia32_pause ();
+#endif
         }
 }
 
 /**
- * Deletes all threads.
+ * Helper function that enables preemption on the fast path, after releasing
+ * the library lock, and starts the quantum that ended while it was disabled.
  */
-void delete_all_thread ()
+void enable_preemption ()
 {
-    for (auto thread: uthreads_array)
+    while (true)
         {
-            delete (thread);
+            if (num_carriers > 1)
+                {
+                    library_lock.clear (std::memory_order_release);
+                }
+            uthread_tls_store (disabled_offset, 0);
+            if (!uthread_tls_load (pending_offset) || !disable_preemption ())
+                {
+                    return;
+                }
+            uthread_tls_store (pending_offset, 0);
+            scheduler (SIGVTALRM);
         }
 }
 
 /**
- * @brief Blocks the thread with ID tid. The thread may be resumed later using uthread_resume.
- *
- * If no thread with ID tid exists it is considered as an error. In addition, it is an error to try blocking the
- * main thread (tid == 0). If a thread blocks itself, a scheduling decision should be made. Blocking a thread in
- * BLOCKED state has no effect and is not considered an error.
- *
- * @return On success, return 0. On failure, return -1.
-*/
-int uthread_block (int tid)
+ * Helper function that stops the running thread of the carrier if another
+ * carrier blocked or terminated it since the carrier last ran library code.
+ */
+void stop_if_descheduled ()
 {
-    block_unblock (SIG_SETMASK);
-    if (tid == 0 || invalid_tid (tid))
+    if (num_carriers == 1)
         {
-            std::cerr << BLOCK_ERROR << std::endl;
-            block_unblock (SIG_UNBLOCK);
-            return -1;
+            return;
         }
-    uthreads_array[tid]->set_uthread_state (BLOCKED);
-    erase_from_ready (tid);
-    if (running_thread->get_tid () == tid)
+    state thread_state = current_carrier ()->running_thread->get_uthread_state ();
+    if (thread_state == BLOCKED || thread_state == TERMINATED)
         {
-            set_clock ();
             scheduler (SIGVTALRM);
         }
-    block_unblock (SIG_UNBLOCK);
-    return 0;
 }
 
 /**
- * @brief Resumes a blocked thread with ID tid and moves it to the READY state.
+ * Handler of SIGVTALRM on the fast path. Inside the library the quantum is
+ * only marked as over, otherwise a scheduling decision is made right away.
+ */
+void preempt (int sig)
+{
+    if (uthread_tls_load (disabled_offset))
+        {
+            uthread_tls_store (pending_offset, 1);
+            return;
+        }
+    scheduler (sig);
+    block_unblock (SIG_UNBLOCK);
+}
+
+/**
+ * Entry point of the threads on the fast path: they are first switched to
+ * from inside the scheduler, so they leave the library before running, and
+ * terminate when their entry point returns.
+ */
+void thread_start ()
+{
+    thread_entry_point entry_point = current_carrier ()->running_thread->get_entry_point ();
+    block_unblock (SIG_UNBLOCK);
+    entry_point ();
+    uthread_terminate (uthread_get_tid ());
+}
+
+/**
+ * Helper function that sets virtual clock, with several carriers the timer
+ * of the calling carrier
+ */
+void set_clock ()
+{
+    write_clock (uthread_quantum_usecs);
+}
+
+/**
+ * Helper function that disarms the virtual clock, see set_clock
+ */
+void stop_clock ()
+{
+    write_clock (0);
+}
+
+/**
+ * Helper function that sets the virtual clock to fire every usecs micro-seconds, 0 disarms it
+ * @param usecs the interval
+ */
+void write_clock (int usecs)
+{
+    if (cooperative)
+        {
+            return;
+        }
+    int seconds = usecs / SECONDS;
+    int useconds = usecs - seconds * SECONDS;
+    Carrier *carrier = current_carrier ();
+    carrier->timer_armed = usecs != 0;
+    if (num_carriers > 1)
+        {
+            struct itimerspec carrier_timer;
+            carrier_timer.it_value.tv_sec = seconds;
+            carrier_timer.it_value.tv_nsec = useconds * NANOSECONDS_PER_USEC;
+            carrier_timer.it_interval = carrier_timer.it_value;
+            if (timer_settime (carrier->timer, 0, &carrier_timer, nullptr) == -1)
+                {
+                    std::cerr << SYS_ERROR_VIRTUAL_TIME << std::endl;
+                    delete_all_thread();
+                    exit (1);
+                }
+            return;
+        }
+    timer.it_value.tv_sec = seconds;
+    timer.it_value.tv_usec = useconds;
+    timer.it_interval.tv_sec = seconds;
+    timer.it_interval.tv_usec = useconds;
+    if (setitimer (ITIMER_VIRTUAL, &timer, nullptr) == -1)
+        {
+            std::cerr << SYS_ERROR_VIRTUAL_TIME << std::endl;
+            delete_all_thread();
+            exit (1);
+        }
+}
+
+/**
+ * Helper function of the tickless mode that disarms the timer of the
+ * carrier while no other thread waits for it and no thread sleeps (the
+ * sleeping threads count the quantums), and arms it again once there is
+ * such a thread.
+ * @param carrier the calling carrier
+ */
+void update_clock (Carrier *carrier)
+{
+    if (!tickless)
+        {
+            return;
+        }
+    bool needed = !carrier->ready_queue->empty () || !sleep_queue.empty () || !io_waiters.empty ();
+    if (needed && !carrier->timer_armed)
+        {
+            set_clock ();
+        }
+    else if (!needed && carrier->timer_armed)
+        {
+            stop_clock ();
+        }
+}
+
+/**
+ * Helper function that wakes up the sleeping threads whose time is over,
+ * only the threads that wake up are looked at.
+ */
+void update_sleeping_threads ()
+{
+    while (!sleep_queue.empty () && sleep_queue.top ()->get_wake_quantum () <= quantums)
+        {
+            Uthread *thread = sleep_queue.pop ();
+            thread->set_is_sleeping (false);
+            if (thread->get_uthread_state () != BLOCKED)
+                {
+                    make_ready (thread);
+                }
+        }
+}
+
+/**
+ * Function that manages the current thread switch,
+ * receives SIGVTALRM
+ */
+void scheduler (int)
+{
+    if (fast_switch)
+        {
+            disable_preemption ();
+        }
+    else
+        {
+            block_unblock (SIG_SETMASK);
+        }
+    Carrier *carrier = current_carrier ();
+    Uthread *previous_thread = carrier->running_thread;
+    bool preempted = carrier->preempting;
+    carrier->preempting = false;
+    if (previous_thread != nullptr)
+        {
+            retire_terminated ();
+            if (previous_thread->get_uthread_state () == TERMINATED)
+                {
+                    // the thread still runs on its stack, it is retired once the carrier left the stack
+                    carrier->terminated_thread = previous_thread;
+                    previous_thread = nullptr;
+                }
+        }
+    if (previous_thread != nullptr && previous_thread->get_uthread_state () == RUNNING
+        && carrier->ready_queue->continues (previous_thread))
+        {
+            // the quantum ended before the policy lets the thread stop, no new quantum starts
+            return;
+        }
+    quantums++;
+    update_sleeping_threads ();
+    bool requeued = false;
+    if (previous_thread != nullptr)
+        {
+            // without signals the mask is not saved, so that switching needs no system call
+            if (!fast_switch && sigsetjmp (previous_thread->getEnv (), !cooperative) == 1)
+                {
+                    return;
+                }
+            // a thread that gives up the CPU is READY already, BLOCKED, SLEEP or WAITING
+            state previous_state = previous_thread->get_uthread_state ();
+            carrier->ready_queue->stopped (previous_thread, previous_state == RUNNING, preempted);
+            if (previous_state != BLOCKED && previous_state != SLEEP && previous_state != WAITING)
+                {
+                    previous_thread->set_uthread_state (READY);
+                    carrier->ready_queue->push (previous_thread);
+                    requeued = true;
+                }
+        }
+    // a thread that parks does not pay for a poll while other threads can run
+    if (!io_waiters.empty () && (requeued || carrier->ready_queue->empty ()))
+        {
+            poll_io (0);
+        }
+    Uthread *next_thread = next_ready (carrier);
+    while (next_thread == nullptr && num_carriers == 1)
+        {
+            next_thread = idle_quantum (carrier);
+        }
+    if (fast_switch)
+        {
+            // the next thread continues inside the library, and leaves it through its own caller
+            void *discarded_context;
+            void **previous_context = previous_thread != nullptr ? previous_thread->get_context ()
+                                                                 : &discarded_context;
+            if (next_thread == nullptr)
+                {
+                    // only with several carriers, the main thread is always READY
+                    carrier->running_thread = nullptr;
+                    uthread_context_switch (previous_context, carrier->idle_context);
+                    return;
+                }
+            run_thread (carrier, next_thread);
+            update_clock (carrier);
+            if (!carrier->ready_queue->empty ())
+                {
+                    wake_idle_carrier ();
+                }
+            if (next_thread != previous_thread)
+                {
+                    uthread_context_switch (previous_context, *next_thread->get_context ());
+                }
+            return;
+        }
+    run_thread (carrier, next_thread);
+    update_clock (carrier);
+    // the mask stays blocked until the next thread's own mask is restored by the jump, a quantum that ended in
+    // between would save over the environment of the next thread while still on the stack of the previous one
+    siglongjmp (next_thread->getEnv (), 1);
+}
+
+/**
+ * Helper function that makes the thread the running thread of the carrier,
+ * starting a quantum of the thread.
+ * @param carrier the carrier
+ * @param thread the thread, not in a READY threads list
+ */
+void run_thread (Carrier *carrier, Uthread *thread)
+{
+    carrier->running_thread = thread;
+    thread->set_carrier (carrier->index);
+    thread->set_uthread_state (RUNNING);
+    thread->increase_quantum ();
+    carrier->ready_queue->started (thread);
+}
+
+/**
+ * Helper function that takes the next READY thread for the carrier, from
+ * its own threads, or from another carrier when it has none.
+ * @param carrier the carrier
+ * @return the thread, nullptr if no thread is READY.
+ */
+Uthread *next_ready (Carrier *carrier)
+{
+    Uthread *thread = carrier->ready_queue->pop_next ();
+    for (int i = 1; thread == nullptr && i < num_carriers; i++)
+        {
+            thread = carriers[(carrier->index + i) % num_carriers]->ready_queue->steal ();
+        }
+    return thread;
+}
+
+/**
+ * Helper function of a single carrier whose threads all wait or sleep: the
+ * process idles for a quantum of real time, since the virtual clock does
+ * not advance, and then the sleeping threads whose time is over wake up.
+ * While threads wait for descriptors it blocks in the poller instead, for
+ * no longer than a quantum if threads sleep. Without sleeping threads and
+ * descriptors nothing could wake a thread up any more.
+ * @param carrier the carrier
+ * @return the next READY thread, nullptr if there is none yet.
+ */
+Uthread *idle_quantum (Carrier *carrier)
+{
+    if (sleep_queue.empty () && io_waiters.empty ())
+        {
+            std::cerr << DEADLOCK_ERROR << std::endl;
+            delete_all_thread ();
+            exit (1);
+        }
+    bool quantum_passed = !sleep_queue.empty ();
+    if (!io_waiters.empty ())
+        {
+            quantum_passed = poll_io (io_timeout_ms ()) == 0 && quantum_passed;
+        }
+    else
+        {
+            struct timespec quantum;
+            quantum.tv_sec = uthread_quantum_usecs / SECONDS;
+            quantum.tv_nsec = (long) (uthread_quantum_usecs % SECONDS) * NANOSECONDS_PER_USEC;
+            while (nanosleep (&quantum, &quantum) == -1 && errno == EINTR)
+                {
+                }
+        }
+    if (quantum_passed)
+        {
+            quantums++;
+            update_sleeping_threads ();
+        }
+    return next_ready (carrier);
+}
+
+/**
+ * Helper function that adds the thread to the end of the READY threads list
+ * of the calling carrier, and wakes up a waiting carrier to take it.
+ * @param thread the thread
+ */
+void push_ready (Uthread *thread)
+{
+    Carrier *carrier = current_carrier ();
+    thread->set_carrier (carrier->index);
+    carrier->ready_queue->push (thread);
+    update_clock (carrier);
+    wake_idle_carrier ();
+}
+
+/**
+ * Helper function that makes room in the READY threads list of every carrier
+ * for all the threads of uthreads_array, so that the scheduler does not
+ * allocate memory inside the SIGVTALRM handler.
+ */
+void reserve_ready ()
+{
+    for (auto carrier: carriers)
+        {
+            carrier->ready_queue->reserve (uthreads_array.size ());
+        }
+}
+
+/**
+ * Helper function that wakes up one of the carriers that wait for work, if
+ * there is such.
+ */
+void wake_idle_carrier ()
+{
+    if (idle_carriers > (io_polling ? 1 : 0))
+        {
+            work_sequence++;
+            syscall (SYS_futex, &work_sequence, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        }
+    else if (io_polling)
+        {
+            io_poller.wake ();
+        }
+}
+
+/**
+ * Helper function that checks if a carrier runs the thread, including a
+ * thread another carrier blocked or terminated that was not stopped yet.
+ * @param thread the thread
+ * @return true if a carrier runs the thread, false otherwise.
+ */
+bool runs_on_carrier (Uthread *thread)
+{
+    return carriers[thread->get_carrier ()]->running_thread == thread;
+}
+
+/**
+ * Helper function that ends the quantum of the carrier that runs the thread,
+ * so that the thread stops once its new state is seen.
+ * @param thread the thread, run by another carrier
+ */
+void interrupt_carrier (Uthread *thread)
+{
+    if (cooperative)
+        {
+            // the thread stops in its next library call
+            return;
+        }
+    pthread_kill (carriers[thread->get_carrier ()]->kernel_thread, SIGVTALRM);
+}
+
+/**
+ * @brief Creates a new thread, whose entry point is the function entry_point with the signature
+ * void entry_point(void).
+ *
+ * The thread is added to the end of the READY threads list.
+ * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
+ * limit (MAX_THREAD_NUM, or the one set by uthread_set_max_threads).
+ * Each thread should be allocated with a stack of size STACK_SIZE bytes, or the one set by uthread_set_stack_size.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn (thread_entry_point entry_point)
+{
+    block_unblock (SIG_SETMASK);
+    int tid = spawn_thread (entry_point, default_stack_size, UTHREAD_DEFAULT_PRIORITY, nullptr, nullptr);
+    block_unblock (SIG_UNBLOCK);
+    return tid;
+}
+
+/**
+ * @brief Creates a new thread like uthread_spawn, with the given priority (see UTHREAD_PRIORITY_LEVELS).
+ *
+ * The priority only matters with UTHREAD_PRIORITY or UTHREAD_FEEDBACK. It is an error to give a priority out of
+ * range.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_with_priority (thread_entry_point entry_point, int priority)
+{
+    block_unblock (SIG_SETMASK);
+    if (invalid_priority (priority))
+        {
+            std::cerr << PRIORITY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    int tid = spawn_thread (entry_point, default_stack_size, priority, nullptr, nullptr);
+    block_unblock (SIG_UNBLOCK);
+    return tid;
+}
+
+/**
+ * @brief Sets the priority of the thread with ID tid (see UTHREAD_PRIORITY_LEVELS).
+ *
+ * A READY thread moves to the end of the threads of its new priority. If no thread with ID tid exists or the
+ * priority is out of range it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority (int tid, int priority)
+{
+    block_unblock (SIG_SETMASK);
+    if (invalid_tid (tid) || invalid_priority (priority))
+        {
+            std::cerr << PRIORITY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    Uthread *thread = uthreads_array[tid];
+    if (thread->get_uthread_state () == READY)
+        {
+            // the policies find a queued thread by its priority
+            SchedulingPolicy *ready_queue = carriers[thread->get_carrier ()]->ready_queue;
+            ready_queue->erase (thread);
+            thread->set_priority (priority);
+            ready_queue->push (thread);
+        }
+    else
+        {
+            thread->set_priority (priority);
+        }
+    preempt_if_outranked ();
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Sets the weight of the thread with ID tid in the fair-share scheduling, the default is
+ * UTHREAD_DEFAULT_WEIGHT.
+ *
+ * A thread of twice the weight gets twice the CPU time. If no thread with ID tid exists or the weight is not
+ * positive it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_weight (int tid, int weight)
+{
+    block_unblock (SIG_SETMASK);
+    if (invalid_tid (tid) || weight <= 0)
+        {
+            std::cerr << WEIGHT_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    uthreads_array[tid]->set_weight (weight);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Sets the minimal time (in micro-seconds) a thread runs before the fair-share scheduling may stop it, the
+ * default is UTHREAD_DEFAULT_GRANULARITY.
+ *
+ * It is an error to set a negative granularity.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_min_granularity (int usecs)
+{
+    block_unblock (SIG_SETMASK);
+    if (usecs < 0)
+        {
+            std::cerr << GRANULARITY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    FairPolicy::granularity_ns = (long long) usecs * NANOSECONDS_PER_USEC;
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that checks if the given priority is out of range
+ * @param priority the priority
+ * @return true if invalid, false otherwise.
+ */
+bool invalid_priority (int priority)
+{
+    return priority < 0 || priority >= UTHREAD_PRIORITY_LEVELS;
+}
+
+/**
+ * Helper function that makes a scheduling decision if a READY thread of the
+ * calling carrier must run before its running thread, which gives up the
+ * rest of its quantum.
+ */
+void preempt_if_outranked ()
+{
+    Carrier *carrier = current_carrier ();
+    if (carrier->ready_queue->outranks (carrier->running_thread))
+        {
+            carrier->running_thread->set_uthread_state (READY);
+            carrier->preempting = true;
+            set_clock ();
+            scheduler (SIGVTALRM);
+        }
+}
+
+/**
+ * @brief Creates a new thread like uthread_spawn, with a stack of stack_size bytes (rounded up to whole pages, and to
+ * 32 KiB, see uthread_init).
+ *
+ * It is an error to call this function with non-positive stack_size.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_with_stack (thread_entry_point entry_point, int stack_size)
+{
+    block_unblock (SIG_SETMASK);
+    if (stack_size <= 0)
+        {
+            std::cerr << STACK_SIZE_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    int tid = spawn_thread (entry_point, stack_size, UTHREAD_DEFAULT_PRIORITY, nullptr, nullptr);
+    block_unblock (SIG_UNBLOCK);
+    return tid;
+}
+
+/**
+ * @brief Sets the stack size of the threads created by uthread_spawn from now on, the default is STACK_SIZE.
+ *
+ * The size is rounded up to whole pages, and to 32 KiB (see uthread_init). It is an error to call this function
+ * with non-positive stack_size.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_stack_size (int stack_size)
+{
+    block_unblock (SIG_SETMASK);
+    if (stack_size <= 0)
+        {
+            std::cerr << STACK_SIZE_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    default_stack_size = stack_size;
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that creates a thread on a stack of the stack pool, the
+ * signals are blocked by the caller.
+ * @param entry_point thread entry point
+ * @param stack_size size of the stack
+ * @param priority priority of the thread
+ * @param arg_entry_point entry point that takes arg instead of entry_point,
+ * which makes the thread joinable, nullptr for a detached thread
+ * @param arg argument of arg_entry_point
+ * @return the ID of the created thread, -1 upon failure.
+ */
+int spawn_thread (thread_entry_point entry_point, size_t stack_size, int priority,
+                  thread_arg_entry_point arg_entry_point, void *arg)
+{
+    if (arg_entry_point != nullptr)
+        {
+            entry_point = &arg_thread_start;
+        }
+    if (entry_point == nullptr)
+        {
+            std::cerr << NULL_SPAWN_ERROR << std::endl;
+            return -1;
+        }
+    release_terminated ();
+    int free_tid = min_free_id ();
+    if (free_tid == -1)
+        {
+            std::cerr << MAX_THREADS_ERROR << std::endl;
+            return -1;
+        }
+    if ((fast_switch || !cooperative) && stack_size < MIN_SCHEDULER_STACK_SIZE)
+        {
+            stack_size = MIN_SCHEDULER_STACK_SIZE;
+        }
+    stack_size = stack_pool.round_size (stack_size);
+    char *stack = stack_pool.acquire (stack_size);
+    if (stack == nullptr)
+        {
+            std::cerr << SYS_ERROR_STACK << std::endl;
+            delete_all_thread ();
+            exit (1);
+        }
+    Uthread *new_thread = new Uthread (free_tid, entry_point, stack, stack_size);
+    new_thread->set_priority (priority);
+    if (arg_entry_point != nullptr)
+        {
+            new_thread->set_arg_entry_point (arg_entry_point, arg);
+            new_thread->set_detached (false);
+        }
+    if (fast_switch)
+        {
+            new_thread->set_context (uthread_context_init (stack, stack_size, &thread_start));
+        }
+    int tid = new_thread->get_tid ();
+    if (tid >= (int) uthreads_array.size ())
+        {
+            uthreads_array.resize (tid + 1, nullptr);
+        }
+    uthreads_array[tid] = new_thread;
+    reserve_ready ();
+    push_ready (new_thread);
+    num_of_uthread++;
+    preempt_if_outranked ();
+    return tid;
+}
+
+/**
+ * Helper function tha finds and returns the minimal free thread id, with a
+ * find-first-set per level of the id bitmap.
+ * @return the free id if such exists, otherwise -1.
+ */
+int min_free_id ()
+{
+    return tid_bitmap.acquire (max_threads);
+}
+
+/**
+ * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
+ *
+ * All the resources allocated by the library for this thread should be released. If no thread with ID tid exists it
+ * is considered an error. Terminating the main thread (tid == 0) will result in the termination of the entire
+ * process using exit(0) (after releasing the assigned library memory).
+ *
+ * @return The function returns 0 if the thread was successfully terminated and -1 otherwise. If a thread terminates
+ * itself or the main thread is terminated, the function does not return.
+*/
+int uthread_terminate (int tid)
+{
+    block_unblock (SIG_SETMASK);
+    if (tid == 0)
+        {
+            delete_all_thread ();
+            exit (0);
+        }
+    if (invalid_tid (tid))
+        {
+            std::cerr << TERMINATE_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    release_terminated ();
+    Uthread *thread = uthreads_array[tid];
+    erase_from_ready (tid);
+    sleep_queue.erase (thread);
+    if (thread->get_wait_queue () != nullptr)
+        {
+            thread->get_wait_queue ()->erase (thread);
+        }
+    uthreads_array[tid] = nullptr;
+    wake_joiners (thread);
+    num_of_uthread--;
+    thread->set_uthread_state (TERMINATED);
+    if (current_carrier ()->running_thread == thread)
+        {
+            set_clock ();
+            scheduler (SIGVTALRM);
+        }
+    if (runs_on_carrier (thread))
+        {
+            // the thread still runs on the stack, the carrier releases it once it stopped
+            interrupt_carrier (thread);
+            block_unblock (SIG_UNBLOCK);
+            return 0;
+        }
+    stack_pool.release (thread->get_stack (), thread->get_stack_size ());
+    delete (thread);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that hands the result of a terminating thread to the
+ * threads that joined it, and releases its id unless it must wait for a
+ * thread to join it.
+ * @param thread the thread, removed from uthreads_array already
+ */
+void wake_joiners (Uthread *thread)
+{
+    int tid = thread->get_tid ();
+    auto joiners = join_queues.find (tid);
+    if (joiners == join_queues.end ())
+        {
+            if (thread->is_detached ())
+                {
+                    tid_bitmap.release (tid);
+                }
+            else
+                {
+                    exit_values[tid] = thread->get_exit_value ();
+                }
+            return;
+        }
+    Uthread *joiner;
+    while ((joiner = joiners->second.front ()) != nullptr)
+        {
+            joiner->set_transfer (thread->get_exit_value ());
+            unpark_thread (joiner);
+        }
+    join_queues.erase (joiners);
+    tid_bitmap.release (tid);
+}
+
+/**
+ * Helper function that moves the thread that terminated while it ran on the
+ * calling carrier to terminated_threads, once another thread runs. It does
+ * not allocate, so it may run inside the SIGVTALRM handler.
+ */
+void retire_terminated ()
+{
+    Carrier *carrier = current_carrier ();
+    if (carrier->terminated_thread != nullptr)
+        {
+            terminated_threads.push_back (carrier->terminated_thread);
+            carrier->terminated_thread = nullptr;
+        }
+}
+
+/**
+ * Helper function that releases the stacks and the objects of the threads
+ * that terminated on their own stacks, must not be called inside the
+ * SIGVTALRM handler.
+ */
+void release_terminated ()
+{
+    retire_terminated ();
+    Uthread *thread;
+    while ((thread = terminated_threads.pop_front ()) != nullptr)
+        {
+            stack_pool.release (thread->get_stack (), thread->get_stack_size ());
+            delete (thread);
+        }
+}
+
+/**
+ * Helper function that erases the given id thread from list of ready
+ * threads, in constant time.
+ * @param tid thread id.
+ */
+void erase_from_ready (int tid)
+{
+    // a WAITING thread is linked in the queue of a synchronization primitive instead
+    Uthread *thread = uthreads_array[tid];
+    if (thread->get_uthread_state () == READY)
+        {
+            carriers[thread->get_carrier ()]->ready_queue->erase (thread);
+        }
+}
+
+/**
+ * Deletes all threads. The stacks are left to the exit of the process,
+ * since the caller may run on one of them.
+ */
+void delete_all_thread ()
+{
+    for (auto thread: uthreads_array)
+        {
+            delete (thread);
+        }
+    for (auto carrier: carriers)
+        {
+            delete (carrier->terminated_thread);
+        }
+    Uthread *thread;
+    while ((thread = terminated_threads.pop_front ()) != nullptr)
+        {
+            delete (thread);
+        }
+}
+
+/**
+ * @brief Blocks the thread with ID tid. The thread may be resumed later using uthread_resume.
+ *
+ * If no thread with ID tid exists it is considered as an error. In addition, it is an error to try blocking the
+ * main thread (tid == 0). If a thread blocks itself, a scheduling decision should be made. Blocking a thread in
+ * BLOCKED state has no effect and is not considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_block (int tid)
+{
+    block_unblock (SIG_SETMASK);
+    if (tid == 0 || invalid_tid (tid))
+        {
+            std::cerr << BLOCK_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    Uthread *thread = uthreads_array[tid];
+    erase_from_ready (tid);
+    thread->set_uthread_state (BLOCKED);
+    if (current_carrier ()->running_thread == thread)
+        {
+            set_clock ();
+            scheduler (SIGVTALRM);
+        }
+    else if (runs_on_carrier (thread))
+        {
+            interrupt_carrier (thread);
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Resumes a blocked thread with ID tid and moves it to the READY state.
+ *
+ * Resuming a thread in a RUNNING or READY state has no effect and is not considered as an error. If no thread with
+ * ID tid exists it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume (int tid)
+{
+    block_unblock (SIG_SETMASK);
+    if (invalid_tid (tid))
+        {
+            std::cerr << RESUME_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    Uthread *thread = uthreads_array[tid];
+    if (thread->get_uthread_state () == BLOCKED && runs_on_carrier (thread))
+        {
+            // blocked by another carrier that did not stop it yet, it keeps running
+            thread->set_uthread_state (RUNNING);
+        }
+    else if (thread->get_uthread_state () == BLOCKED && thread->get_wait_queue () != nullptr)
+        {
+            // it keeps waiting for the synchronization primitive
+            thread->set_uthread_state (WAITING);
+        }
+    else if (!thread->get_is_sleeping ())
+        {
+            make_ready (thread);
+            preempt_if_outranked ();
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that moves a BLOCKED or SLEEP thread to the end of the
+ * READY threads list of the calling carrier, without touching the preemption state so that the
+ * scheduler can use it.
+ * @param thread the thread
+ */
+void make_ready (Uthread *thread)
+{
+    if (thread->get_uthread_state () == BLOCKED || thread->get_uthread_state () == SLEEP)
+        {
+            thread->set_uthread_state (READY);
+            push_ready (thread);
+        }
+}
+
+/**
+ * @brief Blocks the RUNNING thread for num_quantums quantums.
+ *
+ * Immediately after the RUNNING thread transitions to the BLOCKED state a scheduling decision should be made.
+ * After the sleeping time is over, the thread should go back to the end of the READY threads list.
+ * The number of quantums refers to the number of times a new quantums starts, regardless of the reason. Specifically,
+ * the quantums of the thread which has made the call to uthread_sleep isn’t counted.
+ * It is considered an error if the main thread (tid==0) calls this function.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sleep (int num_quantums)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *running_thread = current_carrier ()->running_thread;
+    if (running_thread->get_tid () == 0)
+        {
+            std::cerr << SLEEP_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    running_thread->set_uthread_state (SLEEP);
+    running_thread->set_is_sleeping (true);
+    // the quantum started by the following scheduling decision is not counted
+    running_thread->set_wake_quantum (quantums + num_quantums + 1);
+    sleep_queue.push (running_thread);
+    set_clock ();
+    scheduler (SIGVTALRM);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Moves the RUNNING thread to the end of the READY threads list, and makes a scheduling decision.
+ *
+ * A new quantum starts even if no other thread is READY, and then the calling thread continues.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield ()
+{
+    block_unblock (SIG_SETMASK);
+    current_carrier ()->running_thread->set_uthread_state (READY);
+    if (!tickless)
+        {
+            set_clock ();
+        }
+    scheduler (SIGVTALRM);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Returns the thread ID of the calling thread.
+ *
+ * @return The ID of the calling thread.
+*/
+int uthread_get_tid ()
+{
+    if (num_carriers == 1)
+        {
+            return carriers.front ()->running_thread->get_tid ();
+        }
+    // the running thread of another carrier is read if the thread moves in between
+    block_unblock (SIG_SETMASK);
+    int tid = current_carrier ()->running_thread->get_tid ();
+    block_unblock (SIG_UNBLOCK);
+    return tid;
+}
+
+/**
+ * @brief Returns the total number of quantums since the library was initialized, including the current quantums.
+ *
+ * Right after the call to uthread_init, the value should be 1.
+ * Each time a new quantums starts, regardless of the reason, this number should be increased by 1.
+ *
+ * @return The total number of quantums.
+*/
+int uthread_get_total_quantums ()
+{
+    return quantums;
+}
+
+/**
+ * @brief Returns the number of quantums the thread with ID tid was in RUNNING state.
+ *
+ * On the first time a thread runs, the function should return 1. Every additional quantums
+ * that the thread starts should
+ * increase this value by 1 (so if the thread with ID tid is in RUNNING state when this function is called, include
+ * also the current quantums). If no thread with ID tid exists it is considered an error.
+ *
+ * @return On success, return the number of quantums of the thread with ID tid. On failure, return -1.
+*/
+int uthread_get_quantums (int tid)
+{
+    block_unblock (SIG_SETMASK);
+    if (invalid_tid (tid))
+        {
+            std::cerr << QUANTUM_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    int thread_quantums = uthreads_array[tid]->get_quantum ();
+    block_unblock (SIG_UNBLOCK);
+    return thread_quantums;
+}
+
+/**
+ * Entry point of the threads of uthread_spawn_arg, which exit with the
+ * result of their entry point. It runs outside the library, like the entry
+ * points of the other threads.
+ */
+void arg_thread_start ()
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *thread = current_carrier ()->running_thread;
+    thread_arg_entry_point entry_point = thread->get_arg_entry_point ();
+    void *arg = thread->get_argument ();
+    block_unblock (SIG_UNBLOCK);
+    uthread_exit (entry_point (arg));
+}
+
+/**
+ * @brief Creates a new thread like uthread_spawn, whose entry point is the function entry_point with the signature
+ * void *entry_point(void *), called with arg.
+ *
+ * Unlike the threads of uthread_spawn, the thread is joinable: once it terminated, its ID and its result (the value
+ * entry_point returned, or passed to uthread_exit) are kept until a thread joins it with uthread_join, or it is
+ * detached with uthread_detach.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg (thread_arg_entry_point entry_point, void *arg)
+{
+    block_unblock (SIG_SETMASK);
+    if (entry_point == nullptr)
+        {
+            std::cerr << NULL_SPAWN_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    int tid = spawn_thread (nullptr, default_stack_size, UTHREAD_DEFAULT_PRIORITY, entry_point, arg);
+    block_unblock (SIG_UNBLOCK);
+    return tid;
+}
+
+/**
+ * @brief Waits (WAITING state) until the thread with ID tid terminated, and stores its result in *result unless
+ * result is nullptr.
+ *
+ * A thread terminated by uthread_terminate has the result nullptr. Any number of threads may join a thread that
+ * still runs; it is released once it terminated and they got its result. It is an error to join the calling
+ * thread, a thread that does not exist or a detached thread (including the threads of uthread_spawn).
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join (int tid, void **result)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *running_thread = current_carrier ()->running_thread;
+    void *value;
+    auto exited = exit_values.find (tid);
+    if (exited != exit_values.end ())
+        {
+            value = exited->second;
+            exit_values.erase (exited);
+            tid_bitmap.release (tid);
+        }
+    else if (invalid_tid (tid) || uthreads_array[tid] == running_thread
+             || uthreads_array[tid]->is_detached ())
+        {
+            std::cerr << JOIN_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    else
+        {
+            // the terminating thread puts its result in this thread
+            park (&join_queues[tid]);
+            value = running_thread->get_transfer ();
+        }
+    if (result != nullptr)
+        {
+            *result = value;
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Detaches the thread with ID tid: it is released as soon as it terminates, without a result. A joinable
+ * thread that terminated already is released now.
+ *
+ * If no thread with ID tid exists it is considered an error. Detaching a detached thread has no effect.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach (int tid)
+{
+    block_unblock (SIG_SETMASK);
+    auto exited = exit_values.find (tid);
+    if (exited != exit_values.end ())
+        {
+            exit_values.erase (exited);
+            tid_bitmap.release (tid);
+        }
+    else if (invalid_tid (tid))
+        {
+            std::cerr << DETACH_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    else
+        {
+            uthreads_array[tid]->set_detached (true);
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Terminates the calling thread with the given result, for uthread_join.
+ *
+ * Returning from the entry point of a thread of uthread_spawn_arg does the same.
+ *
+ * @return The function does not return.
+*/
+void uthread_exit (void *result)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *thread = current_carrier ()->running_thread;
+    thread->set_exit_value (result);
+    int tid = thread->get_tid ();
+    block_unblock (SIG_UNBLOCK);
+    uthread_terminate (tid);
+}
+
+/**
+ * Helper function that parks the running thread of the calling carrier at
+ * the end of the queue of a synchronization primitive and makes a
+ * scheduling decision, without a system call. Returns once another thread
+ * unparked it and it runs again.
+ * @param wait_queue the queue
+ */
+void park (ReadyQueue *wait_queue)
+{
+    Uthread *thread = current_carrier ()->running_thread;
+    thread->set_uthread_state (WAITING);
+    thread->set_wait_queue (wait_queue);
+    wait_queue->push_back (thread);
+    scheduler (SIGVTALRM);
+}
+
+/**
+ * Helper function that unparks the first thread of the queue of a
+ * synchronization primitive, to the end of the READY threads list of the
+ * calling carrier unless it was blocked while waiting.
+ * @param wait_queue the queue
+ * @return the thread, nullptr if the queue is empty.
+ */
+Uthread *unpark (ReadyQueue *wait_queue)
+{
+    Uthread *thread = wait_queue->front ();
+    if (thread != nullptr)
+        {
+            unpark_thread (thread);
+        }
+    return thread;
+}
+
+/**
+ * Helper function that unparks the thread from the queue it waits in, see
+ * unpark.
+ * @param thread a parked thread
+ */
+void unpark_thread (Uthread *thread)
+{
+    thread->get_wait_queue ()->erase (thread);
+    thread->set_wait_queue (nullptr);
+    if (thread->get_uthread_state () == WAITING)
+        {
+            thread->set_uthread_state (READY);
+            push_ready (thread);
+        }
+}
+
+/**
+ * @brief Creates an unlocked mutex.
+ *
+ * @return The mutex, nullptr upon failure.
+*/
+uthread_mutex *uthread_mutex_create ()
+{
+    return new uthread_mutex ();
+}
+
+/**
+ * @brief Destroys the mutex. It is an error to destroy a locked mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_destroy (uthread_mutex *mutex)
+{
+    block_unblock (SIG_SETMASK);
+    if (mutex->owner != nullptr)
+        {
+            std::cerr << SYNC_BUSY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    delete (mutex);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Locks the mutex, the calling thread waits while another thread holds it.
+ *
+ * The waiting threads get the mutex in the order they asked for it. It is an error to lock a mutex the calling
+ * thread holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock (uthread_mutex *mutex)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *running_thread = current_carrier ()->running_thread;
+    if (mutex->owner == running_thread)
+        {
+            std::cerr << MUTEX_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    if (mutex->owner == nullptr)
+        {
+            mutex->owner = running_thread;
+        }
+    else
+        {
+            // the thread that unlocks the mutex makes this thread its owner
+            park (&mutex->waiters);
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Locks the mutex if no thread holds it, without waiting.
+ *
+ * @return 0 if the mutex was locked, 1 if another thread holds it, -1 on failure.
+*/
+int uthread_mutex_trylock (uthread_mutex *mutex)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *running_thread = current_carrier ()->running_thread;
+    int result = 0;
+    if (mutex->owner == running_thread)
+        {
+            std::cerr << MUTEX_ERROR << std::endl;
+            result = -1;
+        }
+    else if (mutex->owner != nullptr)
+        {
+            result = 1;
+        }
+    else
+        {
+            mutex->owner = running_thread;
+        }
+    block_unblock (SIG_UNBLOCK);
+    return result;
+}
+
+/**
+ * @brief Unlocks the mutex, which the first waiting thread holds from now on. It is an error to unlock a mutex the
+ * calling thread does not hold.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock (uthread_mutex *mutex)
+{
+    block_unblock (SIG_SETMASK);
+    if (mutex->owner != current_carrier ()->running_thread)
+        {
+            std::cerr << MUTEX_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    mutex->owner = unpark (&mutex->waiters);
+    preempt_if_outranked ();
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that gives the mutex to a thread that waits for it, the
+ * thread is unparked when the mutex is free and waits for it otherwise.
+ * @param mutex the mutex
+ * @param thread the thread, parked in no queue
+ */
+void hand_mutex (uthread_mutex *mutex, Uthread *thread)
+{
+    thread->set_wait_queue (&mutex->waiters);
+    mutex->waiters.push_back (thread);
+    if (mutex->owner == nullptr)
+        {
+            // the mutex has no other waiters while it is free
+            mutex->owner = unpark (&mutex->waiters);
+        }
+}
+
+/**
+ * @brief Creates a condition variable.
+ *
+ * @return The condition variable, nullptr upon failure.
+*/
+uthread_cond *uthread_cond_create ()
+{
+    return new uthread_cond ();
+}
+
+/**
+ * @brief Destroys the condition variable. It is an error to destroy a condition variable threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_destroy (uthread_cond *cond)
+{
+    block_unblock (SIG_SETMASK);
+    if (!cond->waiters.empty ())
+        {
+            std::cerr << SYNC_BUSY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    delete (cond);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Unlocks the mutex and waits until the condition variable is signalled, then holds the mutex again.
+ *
+ * It is an error to wait without holding the mutex, or with another mutex than the threads that already wait.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait (uthread_cond *cond, uthread_mutex *mutex)
+{
+    block_unblock (SIG_SETMASK);
+    if (mutex->owner != current_carrier ()->running_thread)
+        {
+            std::cerr << MUTEX_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    if (!cond->waiters.empty () && cond->mutex != mutex)
+        {
+            std::cerr << COND_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    cond->mutex = mutex;
+    mutex->owner = unpark (&mutex->waiters);
+    // the signalling thread moves this thread to the mutex, which it holds once it runs
+    park (&cond->waiters);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Wakes up the first thread that waits on the condition variable, if there is such.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal (uthread_cond *cond)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *thread = cond->waiters.pop_front ();
+    if (thread != nullptr)
+        {
+            hand_mutex (cond->mutex, thread);
+            preempt_if_outranked ();
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Wakes up all the threads that wait on the condition variable.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast (uthread_cond *cond)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *thread;
+    while ((thread = cond->waiters.pop_front ()) != nullptr)
+        {
+            hand_mutex (cond->mutex, thread);
+        }
+    preempt_if_outranked ();
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Creates a semaphore of the given value. It is an error to give a negative value.
+ *
+ * @return The semaphore, nullptr upon failure.
+*/
+uthread_sem *uthread_sem_create (int value)
+{
+    if (value < 0)
+        {
+            std::cerr << SYNC_VALUE_ERROR << std::endl;
+            return nullptr;
+        }
+    return new uthread_sem (value);
+}
+
+/**
+ * @brief Destroys the semaphore. It is an error to destroy a semaphore threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_destroy (uthread_sem *sem)
+{
+    block_unblock (SIG_SETMASK);
+    if (!sem->waiters.empty ())
+        {
+            std::cerr << SYNC_BUSY_ERROR << std::endl;
+            block_unblock (SIG_UNBLOCK);
+            return -1;
+        }
+    delete (sem);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Decrements the semaphore, the calling thread waits while its value is 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait (uthread_sem *sem)
+{
+    block_unblock (SIG_SETMASK);
+    if (sem->value > 0)
+        {
+            sem->value--;
+        }
+    else
+        {
+            // the thread that posts gives its unit to this thread
+            park (&sem->waiters);
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Increments the semaphore, or wakes up the first thread that waits on it.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post (uthread_sem *sem)
+{
+    block_unblock (SIG_SETMASK);
+    if (unpark (&sem->waiters) == nullptr)
+        {
+            sem->value++;
+        }
+    preempt_if_outranked ();
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Creates a barrier for count threads. It is an error to give a non-positive count.
  *
- * Resuming a thread in a RUNNING or READY state has no effect and is not considered as an error. If no thread with
- * ID tid exists it is considered an error.
+ * @return The barrier, nullptr upon failure.
+*/
+uthread_barrier *uthread_barrier_create (int count)
+{
+    if (count <= 0)
+        {
+            std::cerr << SYNC_VALUE_ERROR << std::endl;
+            return nullptr;
+        }
+    return new uthread_barrier (count);
+}
+
+/**
+ * @brief Destroys the barrier. It is an error to destroy a barrier threads wait on.
  *
  * @return On success, return 0. On failure, return -1.
 */
-int uthread_resume (int tid)
+int uthread_barrier_destroy (uthread_barrier *barrier)
 {
     block_unblock (SIG_SETMASK);
-    if (invalid_tid (tid))
+    if (!barrier->waiters.empty ())
         {
-            std::cerr << RESUME_ERROR << std::endl;
+            std::cerr << SYNC_BUSY_ERROR << std::endl;
             block_unblock (SIG_UNBLOCK);
             return -1;
         }
-    Uthread *thread = uthreads_array[tid];
-    if (!thread->get_is_sleeping ())
+    delete (barrier);
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * @brief Waits until count threads called this function, then all of them continue and the barrier can be used
+ * again.
+ *
+ * @return 1 in the thread that arrived last, 0 in the other threads.
+*/
+int uthread_barrier_wait (uthread_barrier *barrier)
+{
+    block_unblock (SIG_SETMASK);
+    int last = 0;
+    if (++barrier->arrived == barrier->count)
         {
-            if (thread->get_uthread_state () == BLOCKED || thread->get_uthread_state () == SLEEP)
+            barrier->arrived = 0;
+            while (unpark (&barrier->waiters) != nullptr)
                 {
-                    ready_vector.push_back (thread);
-                    thread->set_uthread_state (READY);
                 }
+            last = 1;
+            preempt_if_outranked ();
+        }
+    else
+        {
+            park (&barrier->waiters);
         }
     block_unblock (SIG_UNBLOCK);
-    return 0;
+    return last;
 }
 
 /**
- * @brief Blocks the RUNNING thread for num_quantums quantums.
+ * @brief Creates a channel that holds up to capacity items, a channel of capacity 0 hands every item from a sender to
+ * a receiver directly. It is an error to give a negative capacity.
  *
- * Immediately after the RUNNING thread transitions to the BLOCKED state a scheduling decision should be made.
- * After the sleeping time is over, the thread should go back to the end of the READY threads list.
- * The number of quantums refers to the number of times a new quantums starts, regardless of the reason. Specifically,
- * the quantums of the thread which has made the call to uthread_sleep isn’t counted.
- * It is considered an error if the main thread (tid==0) calls this function.
+ * @return The channel, nullptr upon failure.
+*/
+uthread_channel *uthread_channel_create (int capacity)
+{
+    if (capacity < 0)
+        {
+            std::cerr << SYNC_VALUE_ERROR << std::endl;
+            return nullptr;
+        }
+    return new uthread_channel (capacity);
+}
+
+/**
+ * @brief Destroys the channel, with the items it holds. It is an error to destroy a channel threads wait on.
  *
  * @return On success, return 0. On failure, return -1.
 */
-int uthread_sleep (int num_quantums)
+int uthread_channel_destroy (uthread_channel *channel)
 {
     block_unblock (SIG_SETMASK);
-    if (running_thread->get_tid () == 0)
+    if (!channel->senders.empty () || !channel->receivers.empty ())
         {
-            std::cerr << SLEEP_ERROR << std::endl;
+            std::cerr << SYNC_BUSY_ERROR << std::endl;
             block_unblock (SIG_UNBLOCK);
             return -1;
         }
-    running_thread->set_uthread_state (SLEEP);
-    running_thread->set_is_sleeping (true);
-    running_thread->set_num_q_to_sleep (num_quantums + 1); // decrease 1 quantum in scheduler
-    set_clock ();
-    scheduler (SIGVTALRM);
+    delete (channel);
     block_unblock (SIG_UNBLOCK);
     return 0;
 }
 
 /**
- * @brief Returns the thread ID of the calling thread.
+ * @brief Sends the item on the channel, the calling thread waits while the channel is full.
  *
- * @return The ID of the calling thread.
+ * An item goes to the first waiting receiver directly, if there is such.
+ *
+ * @return On success, return 0. On failure, return -1.
 */
-int uthread_get_tid ()
+int uthread_channel_send (uthread_channel *channel, void *item)
 {
-    return running_thread->get_tid ();
+    block_unblock (SIG_SETMASK);
+    Uthread *receiver = channel->receivers.front ();
+    if (receiver != nullptr)
+        {
+            receiver->set_transfer (item);
+            unpark (&channel->receivers);
+            preempt_if_outranked ();
+        }
+    else if (!channel->full ())
+        {
+            channel->push (item);
+        }
+    else
+        {
+            // a receiver takes the item from this thread
+            current_carrier ()->running_thread->set_transfer (item);
+            park (&channel->senders);
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
 }
 
 /**
- * @brief Returns the total number of quantums since the library was initialized, including the current quantums.
+ * @brief Receives the first item of the channel into *item, the calling thread waits while the channel is empty.
  *
- * Right after the call to uthread_init, the value should be 1.
- * Each time a new quantums starts, regardless of the reason, this number should be increased by 1.
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_channel_receive (uthread_channel *channel, void **item)
+{
+    block_unblock (SIG_SETMASK);
+    Uthread *sender = channel->senders.front ();
+    if (channel->size > 0)
+        {
+            *item = channel->pop ();
+            if (sender != nullptr)
+                {
+                    // the first waiting sender takes the freed place
+                    channel->push (sender->get_transfer ());
+                    unpark (&channel->senders);
+                }
+        }
+    else if (sender != nullptr)
+        {
+            *item = sender->get_transfer ();
+            unpark (&channel->senders);
+        }
+    else
+        {
+            // a sender puts the item in this thread
+            Uthread *running_thread = current_carrier ()->running_thread;
+            park (&channel->receivers);
+            *item = running_thread->get_transfer ();
+        }
+    if (sender != nullptr)
+        {
+            preempt_if_outranked ();
+        }
+    block_unblock (SIG_UNBLOCK);
+    return 0;
+}
+
+/**
+ * Helper function that prepares a descriptor for the I/O functions, with
+ * the library locked.
+ * @param fd the descriptor
+ * @param nonblocking true if the descriptor is read or written, and must
+ * not block the carrier
+ * @return On success, return 0. On failure, return -1 and set errno.
+ */
+int prepare_fd (int fd, bool nonblocking)
+{
+    if (fd < 0)
+        {
+            errno = EBADF;
+            return -1;
+        }
+    if (!io_poller.open () || (nonblocking && !io_poller.make_nonblocking (fd)))
+        {
+            return -1;
+        }
+    return 0;
+}
+
+/**
+ * Helper function that decides what an I/O function does after its call
+ * failed: an interrupted call is repeated, and a call that would block is
+ * repeated once the descriptor is ready.
+ * @param fd the descriptor
+ * @param events EPOLLIN or EPOLLOUT, what the call waits for
+ * @return true if the call should be repeated, false if it failed.
+ */
+bool retry_io (int fd, uint32_t events)
+{
+    int error = current_errno ();
+    if (error == EINTR)
+        {
+            return true;
+        }
+    return (error == EAGAIN || error == EWOULDBLOCK) && wait_fd (fd, events) == 0;
+}
+
+/**
+ * Helper function that parks the running thread until the descriptor may
+ * be ready, the thread checks it again since a wake up is only a hint.
+ * @param fd the descriptor
+ * @param events EPOLLIN, EPOLLOUT or both
+ * @return On success, return 0. On failure, return -1 and set errno.
+ */
+int wait_fd (int fd, uint32_t events)
+{
+    int tid = current_carrier ()->running_thread->get_tid ();
+    if (!io_poller.watch (fd, tid, events))
+        {
+            return -1;
+        }
+    park_io ();
+    io_poller.unwatch (fd, tid);
+    return 0;
+}
+
+/**
+ * Helper function that parks the running thread among the threads that
+ * wait for descriptors, see wake_io_threads.
+ */
+void park_io ()
+{
+    if (!io_polling)
+        {
+            // an idle carrier that waits for work takes over the polling
+            wake_idle_carrier ();
+        }
+    park (&io_waiters);
+}
+
+/**
+ * Helper function that polls the descriptors and wakes up the threads that
+ * wait for them, with the library locked.
+ * @param timeout milliseconds to wait for an event, 0 returns right away
+ * and -1 has no limit
+ * @return the number of events.
+ */
+int poll_io (int timeout)
+{
+    int count = io_poller.wait (io_events, IO_EVENTS, timeout);
+    wake_io_threads (io_events, count);
+    return count;
+}
+
+/**
+ * Helper function that wakes up the threads of the events and of the
+ * deadlines that passed.
+ * @param events the events of the poller
+ * @param count the number of events
+ */
+void wake_io_threads (const struct epoll_event *events, int count)
+{
+    io_poller.ready (events, count, io_ready);
+    for (int tid : io_ready)
+        {
+            // the ids are hints, the thread may have woken up already or terminated
+            if (tid < (int) uthreads_array.size () && uthreads_array[tid] != nullptr
+                && uthreads_array[tid]->get_wait_queue () == &io_waiters)
+                {
+                    unpark_thread (uthreads_array[tid]);
+                }
+        }
+    io_ready.clear ();
+}
+
+/**
+ * Helper function that returns how long a carrier without threads may block
+ * in the poller.
+ * @return the timeout in milliseconds, -1 for no limit.
+ */
+int io_timeout_ms ()
+{
+    // the sleeping threads count quantums, which pass in real time while the carriers are idle
+    int quantum_ms = sleep_queue.empty () ? -1 : (uthread_quantum_usecs + 999) / 1000;
+    return io_poller.timeout_ms (quantum_ms);
+}
+
+/**
+ * Helper function that leaves an I/O function, keeping the errno of its
+ * result.
+ * @param result the result of the function
+ * @return result.
+ */
+ssize_t leave_io (ssize_t result)
+{
+    int error = current_errno ();
+    block_unblock (SIG_UNBLOCK);
+    set_current_errno (error);
+    return result;
+}
+
+/**
+ * Helper function that reads errno of the calling carrier. errno is thread
+ * local, and the compiler may keep its address across a switch that moves
+ * the thread to another carrier, so it is read in a function of its own.
+ * @return errno.
+ */
+__attribute__ ((noinline)) int current_errno ()
+{
+    return errno;
+}
+
+/**
+ * Helper function that sets errno of the calling carrier, see
+ * current_errno.
+ * @param error the value
+ */
+__attribute__ ((noinline)) void set_current_errno (int error)
+{
+    errno = error;
+}
+
+/**
+ * @brief Reads up to count bytes from the descriptor into buf, like read(2), the calling thread waits while the
+ * descriptor has no data.
  *
- * @return The total number of quantums.
+ * The descriptor is made non-blocking, see uthread_close.
+ *
+ * @return The number of bytes read, 0 at end of file. On failure, return -1 and set errno.
 */
-int uthread_get_total_quantums ()
+ssize_t uthread_read (int fd, void *buf, size_t count)
 {
-    return quantums;
+    block_unblock (SIG_SETMASK);
+    ssize_t result = prepare_fd (fd, true);
+    if (result == 0)
+        {
+            while ((result = read (fd, buf, count)) == -1 && retry_io (fd, EPOLLIN))
+                {
+                }
+        }
+    return leave_io (result);
 }
 
 /**
- * @brief Returns the number of quantums the thread with ID tid was in RUNNING state.
+ * @brief Writes the count bytes of buf to the descriptor, like write(2) on a blocking descriptor, the calling thread
+ * waits while the descriptor is full.
  *
- * On the first time a thread runs, the function should return 1. Every additional quantums
- * that the thread starts should
- * increase this value by 1 (so if the thread with ID tid is in RUNNING state when this function is called, include
- * also the current quantums). If no thread with ID tid exists it is considered an error.
+ * The descriptor is made non-blocking, see uthread_close.
  *
- * @return On success, return the number of quantums of the thread with ID tid. On failure, return -1.
+ * @return The number of bytes written, less than count only if writing failed on the way. On failure, return -1 and
+ * set errno.
 */
-int uthread_get_quantums (int tid)
+ssize_t uthread_write (int fd, const void *buf, size_t count)
 {
-    if (invalid_tid (tid))
+    block_unblock (SIG_SETMASK);
+    ssize_t result = prepare_fd (fd, true);
+    size_t written = 0;
+    while (result != -1 && written < count)
         {
-            std::cerr << QUANTUM_ERROR << std::endl;
-            return -1;
+            result = write (fd, (const char *) buf + written, count - written);
+            if (result >= 0)
+                {
+                    written += result;
+                }
+            else if (retry_io (fd, EPOLLOUT))
+                {
+                    result = 0;
+                }
+        }
+    if (result != -1 || written > 0)
+        {
+            result = (ssize_t) written;
+        }
+    return leave_io (result);
+}
+
+/**
+ * @brief Accepts a connection of the listening socket, like accept(2), the calling thread waits while no connection
+ * is pending.
+ *
+ * The socket is made non-blocking, see uthread_close.
+ *
+ * @return The descriptor of the connection. On failure, return -1 and set errno.
+*/
+int uthread_accept (int sockfd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    block_unblock (SIG_SETMASK);
+    int result = prepare_fd (sockfd, true);
+    if (result == 0)
+        {
+            while ((result = accept (sockfd, addr, addrlen)) == -1 && retry_io (sockfd, EPOLLIN))
+                {
+                }
+        }
+    if (result != -1)
+        {
+            // a new descriptor, whose number may have been closed without uthread_close
+            io_poller.forget (result);
+        }
+    return (int) leave_io (result);
+}
+
+/**
+ * @brief Connects the socket to addr, like connect(2), the calling thread waits until the connection is established
+ * or fails.
+ *
+ * The socket is made non-blocking, see uthread_close.
+ *
+ * @return On success, return 0. On failure, return -1 and set errno.
+*/
+int uthread_connect (int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    block_unblock (SIG_SETMASK);
+    int result = prepare_fd (sockfd, true);
+    if (result == 0)
+        {
+            result = connect (sockfd, addr, addrlen);
+        }
+    if (result == -1 && current_errno () == EINPROGRESS)
+        {
+            struct pollfd connecting = {sockfd, POLLOUT, 0};
+            while ((result = poll (&connecting, 1, 0)) == 0)
+                {
+                    if (wait_fd (sockfd, EPOLLOUT) == -1)
+                        {
+                            result = -1;
+                            break;
+                        }
+                }
+            if (result == 1)
+                {
+                    int error = 0;
+                    socklen_t length = sizeof (error);
+                    result = getsockopt (sockfd, SOL_SOCKET, SO_ERROR, &error, &length);
+                    if (result == 0 && error != 0)
+                        {
+                            errno = error;
+                            result = -1;
+                        }
+                }
+        }
+    return (int) leave_io (result);
+}
+
+/**
+ * @brief Waits for events of the descriptors, like poll(2), only the calling thread waits.
+ *
+ * The descriptors are not made non-blocking. A timeout (in milli-seconds) of 0 returns right away, and a negative
+ * timeout has no limit.
+ *
+ * @return The number of descriptors that have events, 0 on timeout. On failure, return -1 and set errno.
+*/
+int uthread_poll (struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    block_unblock (SIG_SETMASK);
+    int tid = current_carrier ()->running_thread->get_tid ();
+    long long deadline = timeout > 0 ? IoPoller::now () + (long long) timeout * 1000000 : 0;
+    int result;
+    while ((result = poll (fds, nfds, 0)) == 0 && timeout != 0 && (timeout < 0 || IoPoller::now () < deadline))
+        {
+            if (!io_poller.open ())
+                {
+                    result = -1;
+                    break;
+                }
+            nfds_t watched = 0;
+            bool watching = true;
+            for (; watching && watched < nfds; watched++)
+                {
+                    uint32_t events = (fds[watched].events & POLLOUT) ? (uint32_t) EPOLLOUT : 0;
+                    if (fds[watched].events & (POLLIN | POLLPRI | POLLRDHUP) || events == 0)
+                        {
+                            // the errors and the hang-ups wake the readers
+                            events |= EPOLLIN;
+                        }
+                    watching = fds[watched].fd < 0 || io_poller.watch (fds[watched].fd, tid, events);
+                }
+            if (watching)
+                {
+                    if (timeout > 0)
+                        {
+                            io_poller.add_deadline (deadline, tid);
+                        }
+                    park_io ();
+                    io_poller.cancel_deadline (deadline, tid);
+                }
+            else
+                {
+                    result = -1;
+                    watched--;
+                }
+            for (nfds_t i = 0; i < watched; i++)
+                {
+                    if (fds[i].fd >= 0)
+                        {
+                            io_poller.unwatch (fds[i].fd, tid);
+                        }
+                }
+            if (result == -1)
+                {
+                    break;
+                }
         }
-    return uthreads_array[tid]->get_quantum ();
+    return (int) leave_io (result);
+}
+
+/**
+ * @brief Closes the descriptor, like close(2). A descriptor used with the I/O functions must be closed with this
+ * function, so that the library forgets it before its number is reused.
+ *
+ * @return On success, return 0. On failure, return -1 and set errno.
+*/
+int uthread_close (int fd)
+{
+    block_unblock (SIG_SETMASK);
+    io_poller.forget (fd);
+    return (int) leave_io (close (fd));
 }
 
 /**
@@ -445,6 +2651,6 @@ int uthread_get_quantums (int tid)
  */
 bool invalid_tid (int tid)
 {
-    return (tid < 0 || tid >= MAX_THREAD_NUM || index_free[tid]);
+    return (tid < 0 || tid >= (int) uthreads_array.size () || uthreads_array[tid] == nullptr);
 }
 
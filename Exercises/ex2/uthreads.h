@@ -7,11 +7,28 @@
 #ifndef _UTHREADS_H
 #define _UTHREADS_H
 
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+#define MAX_THREAD_NUM 100 /* default maximal number of threads, see uthread_set_max_threads */
+#define STACK_SIZE 4096 /* default stack size per thread (in bytes), see uthread_set_stack_size and uthread_init */
 
 typedef void (*thread_entry_point)(void);
+typedef void *(*thread_arg_entry_point)(void *);
+
+/* options of uthread_init_with_flags and uthread_init_carriers */
+#define UTHREAD_FAST_SWITCH 0x1 /* register-only switches, preemption deferred instead of masked (x86-64 only) */
+#define UTHREAD_TICKLESS 0x2 /* the timer is stopped while the running thread is the only one that could run */
+#define UTHREAD_COOPERATIVE 0x4 /* no timer and no signals, threads switch only in library calls */
+#define UTHREAD_PRIORITY 0x8 /* fixed-priority scheduling instead of round-robin */
+#define UTHREAD_FEEDBACK 0x10 /* multilevel feedback scheduling instead of round-robin */
+#define UTHREAD_FAIR 0x20 /* fair-share scheduling by virtual runtime instead of round-robin */
+
+#define UTHREAD_PRIORITY_LEVELS 8 /* priorities are 0 (the most urgent) to UTHREAD_PRIORITY_LEVELS - 1 */
+#define UTHREAD_DEFAULT_PRIORITY 4 /* priority of the main thread and of the threads of uthread_spawn */
+#define UTHREAD_DEFAULT_WEIGHT 1024 /* weight of a new thread in the fair-share scheduling */
+#define UTHREAD_DEFAULT_GRANULARITY 1000 /* default minimal run time (in micro-seconds) of the fair-share scheduling */
 
 /* External interface */
 
@@ -22,25 +39,201 @@ typedef void (*thread_entry_point)(void);
  * exactly once.
  * The input to the function is the length of a quantum in micro-seconds.
  * It is an error to call this function with non-positive quantum_usecs.
+ * The SIGVTALRM handler and the scheduler run on the stack of the interrupted thread, so the stacks of the threads
+ * are at least 32 KiB, whatever STACK_SIZE or uthread_set_stack_size ask for.
  *
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_init(int quantum_usecs);
 
+/**
+ * @brief initializes the thread library like uthread_init, with the options of flags (UTHREAD_FAST_SWITCH).
+ *
+ * With UTHREAD_FAST_SWITCH the threads are switched by saving and loading only the registers a function call
+ * preserves, and the library defers the end of a quantum while it runs instead of masking SIGVTALRM, so
+ * neither a switch nor a library call needs a system call for the signal mask.
+ * With UTHREAD_TICKLESS the timer is stopped while no other thread is READY and no thread sleeps, so a single
+ * runnable thread is never interrupted, and the quantum it runs in lasts until another thread becomes READY.
+ * With UTHREAD_COOPERATIVE no timer is set and no signal is used: a thread runs until it yields, blocks, sleeps
+ * or terminates, and only these calls start a new quantum. The stacks of the threads then keep the size they are
+ * given, unless UTHREAD_FAST_SWITCH is set as well (see uthread_init).
+ * With UTHREAD_PRIORITY the READY thread of the most urgent priority runs next, round-robin between threads of the
+ * same priority, and a thread that becomes READY with a more urgent priority than the running thread of the calling
+ * carrier runs right away. UTHREAD_FEEDBACK orders the threads the same way by a level that starts at the priority
+ * of the thread, moves one level less urgent every time the thread uses its whole quantum, and goes back to the
+ * priority when the thread gives up the CPU before its quantum ends (and every 100 quantums that end on the
+ * carrier, so that no thread starves). A thread that a more urgent thread takes the CPU from keeps its level.
+ * With UTHREAD_FAIR the READY thread that has run the least time (on a monotonic clock) divided by its weight runs
+ * next, so the threads of a carrier get CPU time in proportion to their weights (see uthread_set_weight). A quantum
+ * that ends before the running thread ran the minimal granularity (see uthread_set_min_granularity) does not stop
+ * it, and a thread that becomes READY runs right away if the running thread of the calling carrier is ahead of it
+ * by more than the granularity.
+ * It is an error to ask for more than one of UTHREAD_PRIORITY, UTHREAD_FEEDBACK and UTHREAD_FAIR.
+ * It is an error to ask for an option that is not supported on this machine.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_with_flags(int quantum_usecs, int flags);
+
+/**
+ * @brief initializes the thread library like uthread_init_with_flags, running the threads on num_carriers kernel
+ * threads (carriers) instead of one.
+ *
+ * Every carrier has its own READY threads list and its own quantum timer, measured in the CPU time of the carrier.
+ * Spawned and resumed threads are added to the list of the calling carrier, and a carrier whose list is empty takes
+ * threads from the end of the lists of the other carriers. Blocking or terminating a thread that runs on another
+ * carrier interrupts that carrier, so the thread stops running right away.
+ * With more than one carrier UTHREAD_FAST_SWITCH is implied, and a thread may continue on another kernel thread
+ * after every switch, so it must not keep thread-local data (such as errno) across a library call.
+ * The stacks of the threads are then at least 32 KiB, since a thread may take several SIGVTALRM frames at once.
+ * The total number of quantums counts the quantums of all the carriers. The library needs -pthread and -lrt.
+ * It is an error to call this function with non-positive num_carriers.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_carriers(int quantum_usecs, int flags, int num_carriers);
+
+/**
+ * @brief Sets the maximal number of concurrent threads (including the main thread), the default is
+ * MAX_THREAD_NUM.
+ *
+ * The thread table grows on demand up to the limit. It is an error to set a limit that is not positive or that is
+ * not above the ID of an existing thread.
+ * Every thread stack takes two memory mappings (the stack and its guard page), so more than about
+ * vm.max_map_count / 2 threads need that system limit raised.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_max_threads(int max_thread_num);
+
 /**
  * @brief Creates a new thread, whose entry point is the function entry_point with the signature
  * void entry_point(void).
  *
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
- * Each thread should be allocated with a stack of size STACK_SIZE bytes.
+ * limit (MAX_THREAD_NUM, or the one set by uthread_set_max_threads).
+ * Each thread should be allocated with a stack of size STACK_SIZE bytes, or the one set by uthread_set_stack_size.
  *
  * @return On success, return the ID of the created thread. On failure, return -1.
 */
 int uthread_spawn(thread_entry_point entry_point);
 
 
+/**
+ * @brief Creates a new thread like uthread_spawn, with the given priority (see UTHREAD_PRIORITY_LEVELS).
+ *
+ * The priority only matters with UTHREAD_PRIORITY or UTHREAD_FEEDBACK. It is an error to give a priority out of
+ * range.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_with_priority(thread_entry_point entry_point, int priority);
+
+
+/**
+ * @brief Creates a new thread like uthread_spawn, whose entry point is the function entry_point with the signature
+ * void *entry_point(void *), called with arg.
+ *
+ * Unlike the threads of uthread_spawn, the thread is joinable: once it terminated, its ID and its result (the value
+ * entry_point returned, or passed to uthread_exit) are kept until a thread joins it with uthread_join, or it is
+ * detached with uthread_detach.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg(thread_arg_entry_point entry_point, void *arg);
+
+
+/**
+ * @brief Waits (WAITING state) until the thread with ID tid terminated, and stores its result in *result unless
+ * result is nullptr.
+ *
+ * A thread terminated by uthread_terminate has the result nullptr. Any number of threads may join a thread that
+ * still runs; it is released once it terminated and they got its result. It is an error to join the calling
+ * thread, a thread that does not exist or a detached thread (including the threads of uthread_spawn).
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join(int tid, void **result);
+
+
+/**
+ * @brief Detaches the thread with ID tid: it is released as soon as it terminates, without a result. A joinable
+ * thread that terminated already is released now.
+ *
+ * If no thread with ID tid exists it is considered an error. Detaching a detached thread has no effect.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach(int tid);
+
+
+/**
+ * @brief Terminates the calling thread with the given result, for uthread_join.
+ *
+ * Returning from the entry point of a thread of uthread_spawn_arg does the same.
+ *
+ * @return The function does not return.
+*/
+void uthread_exit(void *result);
+
+
+/**
+ * @brief Sets the priority of the thread with ID tid (see UTHREAD_PRIORITY_LEVELS).
+ *
+ * A READY thread moves to the end of the threads of its new priority. If no thread with ID tid exists or the
+ * priority is out of range it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority(int tid, int priority);
+
+
+/**
+ * @brief Sets the weight of the thread with ID tid in the fair-share scheduling, the default is
+ * UTHREAD_DEFAULT_WEIGHT.
+ *
+ * A thread of twice the weight gets twice the CPU time. If no thread with ID tid exists or the weight is not
+ * positive it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_weight(int tid, int weight);
+
+
+/**
+ * @brief Sets the minimal time (in micro-seconds) a thread runs before the fair-share scheduling may stop it, the
+ * default is UTHREAD_DEFAULT_GRANULARITY.
+ *
+ * It is an error to set a negative granularity.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_min_granularity(int usecs);
+
+
+/**
+ * @brief Creates a new thread like uthread_spawn, with a stack of stack_size bytes (rounded up to whole pages, and to
+ * 32 KiB, see uthread_init).
+ *
+ * It is an error to call this function with non-positive stack_size.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_with_stack(thread_entry_point entry_point, int stack_size);
+
+
+/**
+ * @brief Sets the stack size of the threads created by uthread_spawn from now on, the default is STACK_SIZE.
+ *
+ * The size is rounded up to whole pages, and to 32 KiB (see uthread_init). It is an error to call this function
+ * with non-positive stack_size.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_stack_size(int stack_size);
+
+
 /**
  * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
  *
@@ -91,6 +284,16 @@ int uthread_resume(int tid);
 int uthread_sleep(int num_quantums);
 
 
+/**
+ * @brief Moves the RUNNING thread to the end of the READY threads list, and makes a scheduling decision.
+ *
+ * A new quantum starts even if no other thread is READY, and then the calling thread continues.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield();
+
+
 /**
  * @brief Returns the thread ID of the calling thread.
  *
@@ -122,4 +325,261 @@ int uthread_get_total_quantums();
 int uthread_get_quantums(int tid);
 
 
+/* Synchronization primitives, a thread that waits for one of them is in the WAITING state and never runs until
+ * another thread releases the primitive to it */
+typedef struct uthread_mutex uthread_mutex;
+typedef struct uthread_cond uthread_cond;
+typedef struct uthread_sem uthread_sem;
+typedef struct uthread_barrier uthread_barrier;
+typedef struct uthread_channel uthread_channel;
+
+
+/**
+ * @brief Creates an unlocked mutex.
+ *
+ * @return The mutex, nullptr upon failure.
+*/
+uthread_mutex *uthread_mutex_create();
+
+
+/**
+ * @brief Destroys the mutex. It is an error to destroy a locked mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_destroy(uthread_mutex *mutex);
+
+
+/**
+ * @brief Locks the mutex, the calling thread waits while another thread holds it.
+ *
+ * The waiting threads get the mutex in the order they asked for it. It is an error to lock a mutex the calling
+ * thread holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock(uthread_mutex *mutex);
+
+
+/**
+ * @brief Locks the mutex if no thread holds it, without waiting.
+ *
+ * @return 0 if the mutex was locked, 1 if another thread holds it, -1 on failure.
+*/
+int uthread_mutex_trylock(uthread_mutex *mutex);
+
+
+/**
+ * @brief Unlocks the mutex, which the first waiting thread holds from now on. It is an error to unlock a mutex the
+ * calling thread does not hold.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock(uthread_mutex *mutex);
+
+
+/**
+ * @brief Creates a condition variable.
+ *
+ * @return The condition variable, nullptr upon failure.
+*/
+uthread_cond *uthread_cond_create();
+
+
+/**
+ * @brief Destroys the condition variable. It is an error to destroy a condition variable threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_destroy(uthread_cond *cond);
+
+
+/**
+ * @brief Unlocks the mutex and waits until the condition variable is signalled, then holds the mutex again.
+ *
+ * It is an error to wait without holding the mutex, or with another mutex than the threads that already wait.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait(uthread_cond *cond, uthread_mutex *mutex);
+
+
+/**
+ * @brief Wakes up the first thread that waits on the condition variable, if there is such.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal(uthread_cond *cond);
+
+
+/**
+ * @brief Wakes up all the threads that wait on the condition variable.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast(uthread_cond *cond);
+
+
+/**
+ * @brief Creates a semaphore of the given value. It is an error to give a negative value.
+ *
+ * @return The semaphore, nullptr upon failure.
+*/
+uthread_sem *uthread_sem_create(int value);
+
+
+/**
+ * @brief Destroys the semaphore. It is an error to destroy a semaphore threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_destroy(uthread_sem *sem);
+
+
+/**
+ * @brief Decrements the semaphore, the calling thread waits while its value is 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait(uthread_sem *sem);
+
+
+/**
+ * @brief Increments the semaphore, or wakes up the first thread that waits on it.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post(uthread_sem *sem);
+
+
+/**
+ * @brief Creates a barrier for count threads. It is an error to give a non-positive count.
+ *
+ * @return The barrier, nullptr upon failure.
+*/
+uthread_barrier *uthread_barrier_create(int count);
+
+
+/**
+ * @brief Destroys the barrier. It is an error to destroy a barrier threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_barrier_destroy(uthread_barrier *barrier);
+
+
+/**
+ * @brief Waits until count threads called this function, then all of them continue and the barrier can be used
+ * again.
+ *
+ * @return 1 in the thread that arrived last, 0 in the other threads.
+*/
+int uthread_barrier_wait(uthread_barrier *barrier);
+
+
+/**
+ * @brief Creates a channel that holds up to capacity items, a channel of capacity 0 hands every item from a sender to
+ * a receiver directly. It is an error to give a negative capacity.
+ *
+ * @return The channel, nullptr upon failure.
+*/
+uthread_channel *uthread_channel_create(int capacity);
+
+
+/**
+ * @brief Destroys the channel, with the items it holds. It is an error to destroy a channel threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_channel_destroy(uthread_channel *channel);
+
+
+/**
+ * @brief Sends the item on the channel, the calling thread waits while the channel is full.
+ *
+ * An item goes to the first waiting receiver directly, if there is such.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_channel_send(uthread_channel *channel, void *item);
+
+
+/**
+ * @brief Receives the first item of the channel into *item, the calling thread waits while the channel is empty.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_channel_receive(uthread_channel *channel, void **item);
+
+
+/* I/O functions, a thread that waits for a descriptor is in the WAITING state while the other threads run, and the
+ * library wakes it up once the descriptor may be ready. They fail like the system calls they replace, setting errno,
+ * without printing an error */
+
+
+/**
+ * @brief Reads up to count bytes from the descriptor into buf, like read(2), the calling thread waits while the
+ * descriptor has no data.
+ *
+ * The descriptor is made non-blocking, see uthread_close.
+ *
+ * @return The number of bytes read, 0 at end of file. On failure, return -1 and set errno.
+*/
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+
+/**
+ * @brief Writes the count bytes of buf to the descriptor, like write(2) on a blocking descriptor, the calling thread
+ * waits while the descriptor is full.
+ *
+ * The descriptor is made non-blocking, see uthread_close.
+ *
+ * @return The number of bytes written, less than count only if writing failed on the way. On failure, return -1 and
+ * set errno.
+*/
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+
+/**
+ * @brief Accepts a connection of the listening socket, like accept(2), the calling thread waits while no connection
+ * is pending.
+ *
+ * The socket is made non-blocking, see uthread_close.
+ *
+ * @return The descriptor of the connection. On failure, return -1 and set errno.
+*/
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+
+/**
+ * @brief Connects the socket to addr, like connect(2), the calling thread waits until the connection is established
+ * or fails.
+ *
+ * The socket is made non-blocking, see uthread_close.
+ *
+ * @return On success, return 0. On failure, return -1 and set errno.
+*/
+int uthread_connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+
+
+/**
+ * @brief Waits for events of the descriptors, like poll(2), only the calling thread waits.
+ *
+ * The descriptors are not made non-blocking. A timeout (in milli-seconds) of 0 returns right away, and a negative
+ * timeout has no limit.
+ *
+ * @return The number of descriptors that have events, 0 on timeout. On failure, return -1 and set errno.
+*/
+int uthread_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+
+/**
+ * @brief Closes the descriptor, like close(2). A descriptor used with the I/O functions must be closed with this
+ * function, so that the library forgets it before its number is reused.
+ *
+ * @return On success, return 0. On failure, return -1 and set errno.
+*/
+int uthread_close(int fd);
+
+
 #endif